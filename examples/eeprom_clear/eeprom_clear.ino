@@ -11,9 +11,9 @@
 void setup()
 {
   EEPROM.begin(512);
-  // write a 0 to all 512 bytes of the EEPROM
-  for (int i = 0; i < 512; i++)
-    EEPROM.write(i, 0);
+  // write a 0 to all 512 bytes of the EEPROM.  Pages that are already
+  // all 0 are skipped.
+  EEPROM.clear(0);
 
   // turn the LED on when we're done
   pinMode(13, OUTPUT);
@@ -21,153 +21,8 @@
 
 #include "Arduino.h"
 #include "UNIO_EEPROM.h"
+#include "UNIO_EEPROM_Impl.h"
 
-UNIOEEPROMClass::UNIOEEPROMClass(UNIO *unio, size_t size, uint8_t blockSize)
- : _free(false), _unio(unio), _size(size), _blockSize(blockSize)
-{
-    _init();
-}
-UNIOEEPROMClass::UNIOEEPROMClass(unsigned int address, size_t size, uint8_t blockSize)
- : _free(true), _unio(new UNIO((uint8_t)address)), _size(size), _blockSize(blockSize)
-{
-    _init();
-}
-void UNIOEEPROMClass::_init(void) {
-    _pages = _size / UNIO_PAGE_SIZE; 
-    _dirtySize = (_size / (UNIO_PAGE_SIZE * sizeof(uint8_t))) + 1;
-    _writePage = 0;
-    if (_blockSize > _size) {
-        _blockSize = _size;
-    }
-    if (_size > 0) {
-        _buffer = new uint8_t[_size];
-    }
-    _dirty = new uint8_t[_dirtySize];
-    memset(_dirty, 0, _dirtySize);
-}
-
-UNIOEEPROMClass::~UNIOEEPROMClass()
-{
-    end();
-    if (_free) {
-        delete _unio;
-    }
-    delete [] _buffer;
-    delete [] _dirty;
-    _buffer = NULL;
-}
-
-void UNIOEEPROMClass::begin(void) {
-    // Read out the E2
-    if (_size > 0) {
-        _unio->read(_buffer, 0, _size);
-    }
-}
-
-void UNIOEEPROMClass::end(void) {
-    // Commit any changes before we end
-    flush();
-}
-
-
-uint8_t UNIOEEPROMClass::read(int address) {
-    if (!_goodAddress(address)) {
-        return 0;
-    }
-    return _buffer[address];
-}
-
-void UNIOEEPROMClass::write(int address, uint8_t value) {
-    if (!_goodAddress(address)) {
-        return;
-    }
-
-    // Optimise _dirty. Only flagged if data written is different.
-    uint8_t* data = &_buffer[address];
-    if (*data != value)
-    {
-        *data = value;
-        _setDirty(_addressPage(address));
-    }
-}
-
-bool UNIOEEPROMClass::readBlock(int block, uint8_t *buffer) {
-    int address = _blockAddress(block);
-    if (!_goodAddress(address, _blockSize) || !buffer || (_blockSize == 0)) {
-        return false;
-    }
-    memcpy(buffer, &_buffer[address], _blockSize);
-    return true;
-}
-
-bool UNIOEEPROMClass::writeBlock(int block, uint8_t *buffer) {
-    int address = _blockAddress(block);
-    uint8_t index;
-    uint8_t * data;
-    if (!_goodAddress(address, _blockSize) || !buffer || (_blockSize == 0)) {
-        return false;
-    }
-    // Optimise _dirty. Only flagged if data written is different.
-    for (index = 0; index < _blockSize; index++) {
-        data = &_buffer[address + index];
-        if (*data != buffer[index])
-        {
-            *data = buffer[index];
-            _setDirty(_addressPage(address));
-        }
-
-    }
-    return true;
-}
-
-bool UNIOEEPROMClass::copyBlock(int dest, int src) {
-    int address = _blockAddress(src);
-    if (!_goodAddress(address, _blockSize)) {
-        return false;
-    }
-    return writeBlock(dest, &_buffer[address]);
-}
-
-bool UNIOEEPROMClass::commit(void) {
-    if (!_buffer) {
-        return false;
-    }
-    if (_writePage >= _pages) {
-        _writePage = 0;
-    }
-    if (!_isDirty(_writePage)) {
-        _writePage++;
-        return true;
-    }
-
-    // This needs to be the last thing before the write_enable
-    if (_unio->is_writing()) {
-        // Previous write is not finished.
-        return false;
-    }
-    if (!_unio->enable_write()) {
-        return false;
-    }
-    if (!_unio->start_write(&_buffer[_pageAddress(_writePage)], _pageAddress(_writePage), UNIO_PAGE_SIZE)) {
-        return false;
-    }
-
-    _clearDirty(_writePage);
-    _writePage++;
-    return true;
-}
-
-bool UNIOEEPROMClass::flush(void) {
-    uint16_t index;
-    if (!_buffer) {
-        return false;
-    }
-    while (_unio->is_writing());
-    for (index = 0; index < _pages; index++) {
-        if (_isDirty(index)) {
-            _unio->simple_write(&_buffer[_pageAddress(index)], _pageAddress(index), UNIO_PAGE_SIZE);
-            _clearDirty(index);
-        }
-    }
-    return true;
-}
\ No newline at end of file
+template class UNIOEEPROMBase<UNIO>;
+template class UNIOEEPROMPatchBase<UNIOEEPROMClass>;
+template class UNIOEEPROMSchemaBase<UNIOEEPROMClass>;
@@ -33,29 +33,365 @@
 #define UNIO_PAGE_SIZE 16
 #endif
 
+/**
+ * What reload() does with pages in the range that have unwritten changes
+ */
+#define UNIO_RELOAD_KEEP 0      //!< Keep the copy in the cache
+#define UNIO_RELOAD_DEVICE 1    //!< Take the copy on the device
+#define UNIO_RELOAD_CONFLICT 2  //!< Change nothing if there are any
+
+/**
+ * Events passed to UNIOEEPROMCallback
+ */
+#define UNIO_EVENT_WRITE_START 0  //!< A page write has been sent
+#define UNIO_EVENT_WRITE_DONE 1   //!< A page write cycle has finished
+#define UNIO_EVENT_FLUSH_DONE 2   //!< flush() is done.  The page is -1
+
+/**
+ * How writes to a page reach the device
+ */
+#define UNIO_WRITE_BACK 0     //!< Cached until commit() or flush()
+#define UNIO_WRITE_THROUGH 1  //!< The page write starts as soon as it changes
+#define UNIO_WRITE_AROUND 2   //!< Straight to the device, not cached
+
+/**
+ * The size of one exportDelta() record: the page, low byte first, then the
+ * page.  Bytes past the end of the device are sent as 0xFF.  This is for
+ * UNIO; other devices use UNIOEEPROMBackend<Device>::delta_record.
+ */
+#define UNIO_DELTA_RECORD (2 + UNIO_PAGE_SIZE)
+
+/**
+ * How setChips() spreads the pages over the chips
+ */
+#define UNIO_CHIPS_CONCAT 0  //!< Each chip has a run of pages
+#define UNIO_CHIPS_STRIPE 1  //!< Pages go to the chips in turn
+
+/**
+ * Define UNIO_EEPROM_TRACE to the number of events to keep, to log these
+ * calls into a ring buffer that traceRead() drains.  When it is full the
+ * oldest event is dropped.  Calls turned away for a bad address are not
+ * logged.  It is off by default and costs nothing then.
+ */
+#define UNIO_TRACE_READ 1    //!< read()
+#define UNIO_TRACE_WRITE 2   //!< write()
+#define UNIO_TRACE_GET 3     //!< get()
+#define UNIO_TRACE_PUT 4     //!< put()
+#define UNIO_TRACE_BLOCK 5   //!< writeBlock().  The address is the block's.
+#define UNIO_TRACE_COMMIT 6  //!< commit().  The address and length are 0.
+#define UNIO_TRACE_FLUSH 7   //!< flush().  The address and length are 0.
+
+/**
+ * The size of one trace event: the UNIO_TRACE_* call, the length, the
+ * address, low byte first, then millis(), low byte first.  The length is one
+ * byte, so a call over 255 bytes is logged as 255.
+ */
+#define UNIO_TRACE_RECORD 8
+
+/**
+ * What UNIOEEPROMSchemaBase::begin() found
+ */
+#define UNIO_SCHEMA_UNKNOWN -1   //!< A header we can not migrate from
+#define UNIO_SCHEMA_OK 0         //!< The header matches
+#define UNIO_SCHEMA_NEW 1        //!< No header.  One has been written
+#define UNIO_SCHEMA_MIGRATING 2  //!< A migration has started or is going on
+
+/**
+ * Migration steps
+ */
+#define UNIO_MIGRATE_COPY 0       //!< Copy length bytes from src to dest
+#define UNIO_MIGRATE_FILL 1       //!< Fill length bytes at dest with src
+#define UNIO_MIGRATE_TRANSFORM 2  //!< transform() length bytes from src to dest, in one page
+
+/**
+ * The size of the schema header: a magic number, the version, the layout
+ * hash, the version being migrated from (0xFFFF when not migrating), the step
+ * and the bytes of it done, a serial number, then a CRC-8 of the rest.  All
+ * low byte first.  There are two copies, a page apart, written in turn, so a
+ * header cut off by a power failure leaves the one before it.
+ */
+#define UNIO_SCHEMA_HEADER 16
+#define UNIO_SCHEMA_MAGIC 0x4553
+
+#ifndef UNIO_EEPROM_MAX_RETRIES
+#define UNIO_EEPROM_MAX_RETRIES 8
+#endif
+
+/**
+ * The most chips setChips() takes.  This can not be more than 8.
+ */
+#ifndef UNIO_EEPROM_CHIPS
+#define UNIO_EEPROM_CHIPS 4
+#endif
+
+#ifndef UNIO_EEPROM_CALLBACKS
+#define UNIO_EEPROM_CALLBACKS 2
+#endif
+
+/**
+ * The most old versions UNIOEEPROMSchemaBase can migrate from
+ */
+#ifndef UNIO_EEPROM_MIGRATIONS
+#define UNIO_EEPROM_MIGRATIONS 2
+#endif
+
 #define DIRTY_BIT(page) ((1 << (page & 0x7)) & 0xFF)
 #define DIRTY_BYTE(page) (page >> 3)
 
-class UNIOEEPROMClass {
+/**
+ * Bookkeeping kept for every page in the cache
+ */
+struct UNIOEEPROMPage {
+    uint32_t dirtyTime;  //!< millis() when the page went from clean to dirty
+    uint32_t dirtySeq;   //!< sequence() of the first change not written yet
+    uint16_t epoch;      //!< fence() epoch of the last change
+    uint16_t retryAt;    //!< commit() count before the page is tried again
+    uint8_t failures;    //!< Write failures in a row
+    uint8_t mode;        //!< UNIO_WRITE_*
+};
+
+/**
+ * Called with one of UNIO_EVENT_*, the page, millis() and the arg it was
+ * added with
+ */
+typedef void (*UNIOEEPROMCallback)(uint8_t event, int page, uint32_t time, void *arg);
+
+/**
+ * Makes length bytes of a new field in to from the old bytes in from.  The
+ * new field has to fit in one page.
+ */
+typedef void (*UNIOEEPROMTransform)(const uint8_t *from, uint8_t *to, uint16_t length);
+
+/**
+ * One step of a migration.  See UNIOEEPROMSchemaBase.
+ */
+struct UNIOEEPROMMigration {
+    uint8_t op;                     //!< UNIO_MIGRATE_*
+    uint16_t dest;                  //!< Where the new field goes
+    uint16_t src;                   //!< Where the old field is, or the fill byte
+    uint16_t length;                //!< Bytes written at dest
+    UNIOEEPROMTransform transform;  //!< For UNIO_MIGRATE_TRANSFORM
+};
+
+/**
+ * What the cache needs to know about a device type.  A device has read(),
+ * start_write(), enable_write(), is_writing() and simple_write() like UNIO,
+ * and a static page_size.  UNIO has no page_size, so it gets UNIO_PAGE_SIZE
+ * here.  delta_record is the size of one exportDelta() record on the device,
+ * for sizing the buffers.
+ */
+template<class Device>
+struct UNIOEEPROMBackend {
+    static const uint16_t page_size = Device::page_size;
+    static const uint16_t delta_record = 2 + page_size;
+};
+template<>
+struct UNIOEEPROMBackend<UNIO> {
+    static const uint16_t page_size = UNIO_PAGE_SIZE;
+    static const uint16_t delta_record = UNIO_DELTA_RECORD;
+};
+
+template<class Device> class UNIOEEPROMBase;
+typedef UNIOEEPROMBase<UNIO> UNIOEEPROMClass;
+template<typename T, class EEPROM = UNIOEEPROMClass> class UNIOEEPROMEdit;
+template<typename T, int Address, uint16_t Pages = 0, class EEPROM = UNIOEEPROMClass> class UNIOEEPROMField;
+
+/**
+ * The cache, over any device type.  The device calls are resolved at compile
+ * time, so they can be inlined.  The code for UNIO is built in
+ * UNIO_EEPROM.cpp; include UNIO_EEPROM_Impl.h to use another device.
+ */
+template<class Device>
+class UNIOEEPROMBase {
+    template<typename T, class EEPROM> friend class UNIOEEPROMEdit;
+    template<typename T, int Address, uint16_t Pages, class EEPROM> friend class UNIOEEPROMField;
 private:
     void _init(void);
     bool _free = false;
 public:
-    UNIOEEPROMClass(UNIO *unio, size_t size, uint8_t blockSize = 0);
-    UNIOEEPROMClass(unsigned int address, size_t size, uint8_t blockSize = 0);
-    ~UNIOEEPROMClass();
+    enum {
+        PAGE_SIZE = UNIOEEPROMBackend<Device>::page_size,        //!< Bytes in a page
+        DELTA_RECORD = UNIOEEPROMBackend<Device>::delta_record   //!< See UNIO_DELTA_RECORD
+    };
+
+    /**
+     * The number of pages size bytes at address land on.  Each one is a page
+     * write when they change.
+     */
+    static constexpr uint16_t pagesUnder(int address, size_t size)
+    {
+        return (size == 0) ? 0 : ((address + size - 1) / PAGE_SIZE) - (address / PAGE_SIZE) + 1;
+    }
+    /**
+     * The fewest pages size bytes can land on
+     */
+    static constexpr uint16_t fewestPages(size_t size)
+    {
+        return (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    }
+
+    UNIOEEPROMBase(Device *unio, size_t size, uint8_t blockSize = 0);
+    UNIOEEPROMBase(unsigned int address, size_t size, uint8_t blockSize = 0);
+    ~UNIOEEPROMBase();
 
     void begin(void);
+    bool setChips(Device **chips, uint8_t count, uint8_t layout = UNIO_CHIPS_CONCAT);
+    uint8_t chips(void) {
+        return _chips;
+    }
+    bool setMirror(Device *mirror);
+    Device *mirror(void) {
+        return _mirror;
+    }
+    uint16_t mirrorRepairs(void) {
+        return _repairs;
+    }
+    void beginAsync(uint16_t chunk = 4 * PAGE_SIZE);
+    bool poll(void);
+    /**
+     * True once every page of the cache has been read.  A write around drops
+     * its page until something reads it again.
+     */
+    bool loaded(void) {
+        return !_stale;
+    }
     uint8_t read(int address);
     void write(int address, uint8_t val);
     bool commit(void);
     bool flush(void);
     void end(void);
+    bool discard(void);
+    bool discardRange(int address, size_t length);
+    int reload(int address, size_t length, uint8_t policy = UNIO_RELOAD_KEEP);
+
+    /**
+     * Sets how writes reach the device, for everything or for the pages
+     * under a range.  See UNIO_WRITE_*.  Write around pages are dropped from
+     * the cache when written and read back the next time they are used,
+     * including before the next write, which is skipped if it changes nothing.
+     * Write through and write around writes wait for the device, and
+     * write around is not held back by fence().
+     */
+    void setWriteMode(uint8_t mode) {
+        setWriteMode(0, _size, mode);
+    }
+    bool setWriteMode(int address, size_t length, uint8_t mode);
+    uint8_t writeMode(int address) {
+        return _goodAddress(address) ? _page[_addressPage(address)].mode : UNIO_WRITE_BACK;
+    }
+
+    bool addCallback(UNIOEEPROMCallback callback, void *arg = NULL);
+    void removeCallback(UNIOEEPROMCallback callback);
+    /**
+     * Counts every change made to the cache.  Once durableSequence() reaches
+     * the value sequence() had after a change, that change is on the chip.
+     */
+    uint32_t sequence(void) {
+        return _sequence;
+    }
+    uint32_t durableSequence(void);
+    bool isDurable(uint32_t seq) {
+        return durableSequence() >= seq;
+    }
+    bool waitDurable(uint32_t seq);
+
+    /**
+     * Everything changed before a fence is on the chip before anything
+     * changed after it.  Pages between two fences are still written in any
+     * order.  Changing a page that is still dirty from before a fence writes
+     * out everything up to that fence first, so it waits for the device.
+     */
+    void fence(void) {
+        _epoch++;
+    }
+
+    /**
+     * A page that fails to write this many times in a row is quarantined:
+     * commit() stops trying it, but it stays dirty.  0 means never.
+     */
+    void setMaxRetries(uint8_t retries) {
+        _maxRetries = retries;
+    }
+    uint32_t writeFailures(void) {
+        return _failures;
+    }
+    uint8_t pageFailures(uint16_t page) {
+        return (page < _pages) ? _page[page].failures : 0;
+    }
+    bool isQuarantined(uint16_t page) {
+        return (_maxRetries > 0) && (pageFailures(page) >= _maxRetries);
+    }
+    uint16_t quarantined(void);
+    void clearFailures(void);
+
+    /**
+     * Forgets which pages have changed, once a replica matches us.  Pages
+     * that change after this are sent by the next exportDelta().  Call
+     * markChanged(0, size()) to send everything.
+     */
+    void checkpoint(void) {
+        memset(_changed, 0, _dirtySize);
+    }
+    bool markChanged(int address, size_t length);
+    uint16_t changedPages(void);
+    size_t exportDelta(uint8_t *buffer, size_t length);
+    bool applyDelta(const uint8_t *delta, size_t length);
+
+    uint32_t maxDirtyAge(void);
+    int oldestDirtyPage(void);
+    /**
+     * Sets the longest time (ms) a page may stay dirty.  0 turns it off.
+     *
+     * With a deadline set, commit() holds each dirty page back for half of
+     * the deadline, so repeated writes to it are batched into one page
+     * write, and then writes the oldest dirty page first.  commit() has to
+     * be called often enough to get through the dirty pages in the other
+     * half of the deadline.
+     */
+    void setDirtyDeadline(uint32_t deadline) {
+        _dirtyDeadline = deadline;
+    }
+    uint32_t dirtyDeadline() {
+        return _dirtyDeadline;
+    }
+    /**
+     * Sets the most bytes read from the device in one go, so that long
+     * reads do not hold the bus (and interrupts) for too long.  It is
+     * rounded down to whole pages.  0 means no limit.
+     */
+    void setMaxReadChunk(uint16_t bytes) {
+        _maxReadChunk = bytes;
+    }
+    uint16_t maxReadChunk() {
+        return _maxReadChunk;
+    }
 
     bool readBlock(int block, uint8_t *buffer);
     bool writeBlock(int block, uint8_t *data);
     bool copyBlock(int dest, int src);
 
+    bool readBytes(int address, uint8_t *buffer, size_t length);
+    bool writeBytes(int address, const uint8_t *data, size_t length);
+    bool fill(int address, uint8_t value, size_t length);
+    int fillRange(int address, uint8_t value, size_t length);
+    int clear(uint8_t value = 0xFF);
+    bool equals(int address, const uint8_t *data, size_t length);
+    int programImage(const uint8_t *image, size_t length);
+    bool applyPatch(const uint8_t *patch, size_t length);
+
+#ifdef UNIO_EEPROM_TRACE
+    size_t traceRead(uint8_t *buffer, size_t length);
+    uint16_t traceCount(void) {
+        return _traceCount;
+    }
+    /**
+     * Events dropped because the trace was full
+     */
+    uint32_t traceLost(void) {
+        return _traceLost;
+    }
+#endif
+
     size_t size() {
         return _size;
     }
@@ -70,7 +406,8 @@ public:
         if (!_goodAddress(address, sizeof(T))) {
         return t;
         }
-
+        _trace(UNIO_TRACE_GET, address, sizeof(T));
+        _load(address, sizeof(T));
         memcpy((uint8_t*) &t, _buffer + address, sizeof(T));
         return t;
     }
@@ -78,27 +415,218 @@ public:
     template<typename T> 
     const T &put(int address, const T &t) {
         if (!_goodAddress(address, sizeof(T))) {
-        return t;
+            return t;
         }
-        memcpy(_buffer + address, (const uint8_t*) &t, sizeof(T));
-        _setDirty(_addressPage(address));
+        _trace(UNIO_TRACE_PUT, address, sizeof(T));
+        writeBytes(address, (const uint8_t*) &t, sizeof(T));
         return t;
     }
 
+    /**
+     * Returns a pointer straight into the cache, or NULL if the address is
+     * out of range or not aligned for T.  Nothing is copied.
+     */
+    template<typename T>
+    const T *view(int address) {
+        if (!_goodView(address, sizeof(T), alignof(T))) {
+            return NULL;
+        }
+        _load(address, sizeof(T));
+        return (const T*) (_buffer + address);
+    }
+
+    /**
+     * Returns a guard that gives write access straight into the cache.  The
+     * pages under the T are marked dirty when the guard goes out of scope.
+     */
+    template<typename T>
+    UNIOEEPROMEdit<T, UNIOEEPROMBase> edit(int address) {
+        T *data = NULL;
+        if (_goodView(address, sizeof(T), alignof(T))) {
+            _load(address, sizeof(T));
+            _fenceChangeRange(address, sizeof(T));
+            data = (T*) (_buffer + address);
+        }
+        return UNIOEEPROMEdit<T, UNIOEEPROMBase>(this, address, data);
+    }
+
 protected:
-    UNIO *_unio = NULL;
+    /**
+     * Picks pages for _readPlan()
+     */
+    typedef bool (UNIOEEPROMBase::*PageTest)(uint16_t page);
+
+    Device *_unio = NULL;
     uint8_t* _buffer = NULL;
     uint8_t* _dirty = NULL;
+    uint8_t* _unloaded = NULL;
+    uint8_t* _changed = NULL;
+    UNIOEEPROMPage* _page = NULL;
     size_t _size = 0;
     uint8_t _blockSize = 0;
     uint16_t _pages = 0;
     uint8_t _dirtySize = 0;
     uint16_t _writePage = 0;
+    uint32_t _dirtyDeadline = 0;
+    uint16_t _maxReadChunk = 0;
+    bool _loading = false;
+    bool _stale = false;
+    bool _through = false;
+    uint16_t _loadChunk = 0;
+    uint16_t _loadPage = 0;
+    uint32_t _sequence = 0;
+    Device *_chip[UNIO_EEPROM_CHIPS] = { NULL };
+    uint8_t _chips = 1;
+    bool _striped = false;
+    uint16_t _chipPages = 0;
+    uint8_t _busy = 0;
+    int _writing[UNIO_EEPROM_CHIPS] = { 0 };
+    uint32_t _writingSeq[UNIO_EEPROM_CHIPS] = { 0 };
+    uint16_t _writingEpoch[UNIO_EEPROM_CHIPS] = { 0 };
+    uint16_t _epoch = 0;
+    uint16_t _drainEpoch = 0;
+    uint8_t _maxRetries = UNIO_EEPROM_MAX_RETRIES;
+    uint32_t _failures = 0;
+    uint16_t _commits = 0;
+    Device *_mirror = NULL;
+    bool _mirrorWriting = false;
+    uint8_t *_crc = NULL;
+    uint8_t *_mirrorPending = NULL;
+    uint8_t *_crcPrimary = NULL;
+    uint8_t *_crcMirror = NULL;
+    uint16_t _repairs = 0;
+    UNIOEEPROMCallback _callback[UNIO_EEPROM_CALLBACKS] = { NULL };
+    void *_callbackArg[UNIO_EEPROM_CALLBACKS] = { NULL };
+#ifdef UNIO_EEPROM_TRACE
+    uint8_t _traceBuffer[UNIO_EEPROM_TRACE * UNIO_TRACE_RECORD] = { 0 };
+    uint16_t _traceHead = 0;
+    uint16_t _traceCount = 0;
+    uint32_t _traceLost = 0;
+
+    void _trace(uint8_t event, int address, size_t length);
+#else
+    void _trace(uint8_t, int, size_t)
+    {
+    }
+#endif
+
+    uint16_t _firstEpoch(void);
+    bool _flushEpochs(uint16_t last);
+    bool _olderInFlight(uint16_t epoch);
+    /**
+     * Call before changing a page in the cache.  If the page is still dirty
+     * from before a fence, the epochs up to its own go out first.
+     */
+    void _fenceChange(uint16_t page)
+    {
+        if (_isDirty(page) && (_page[page].epoch != _epoch)) {
+            _flushEpochs(_page[page].epoch);
+        }
+    }
+    void _fenceChangeRange(int address, size_t size)
+    {
+        int page;
+        for (page = _addressPage(address); page <= _addressPage(address + size - 1); page++) {
+            _fenceChange(page);
+        }
+    }
+    int _oldestDirty(bool ordered);
+    bool _inEpoch(uint16_t page, uint16_t epoch)
+    {
+        return _isDirty(page) && (_page[page].epoch == epoch);
+    }
+    /**
+     * Pages commit() can write now.  Pages backing off after a failure, or
+     * in quarantine, wait.
+     */
+    bool _canWrite(uint16_t page, uint16_t epoch)
+    {
+        return _inEpoch(page, epoch) && ((_page[page].failures == 0)
+            || (!isQuarantined(page) && ((int16_t)(_commits - _page[page].retryAt) >= 0)));
+    }
+    void _writeFailed(uint16_t page);
+    bool _startWrite(uint16_t page);
+    bool _writeAround(int address, const uint8_t *data, size_t length);
+    void _writeThrough(void);
+    /**
+     * Starts the writes for write through pages changed by the last call
+     */
+    void _flushThrough(void)
+    {
+        if (_through) {
+            _writeThrough();
+        }
+    }
+    void _event(uint8_t event, int page);
+    void _writeDone(uint8_t chip);
+    bool _writeBusy(uint8_t chip);
+    bool _writeBusy(void);
+    int _idlePage(uint16_t epoch);
+    void _writeWait(void);
+    uint8_t _chipOf(uint16_t page)
+    {
+        if (_chips == 1) {
+            return 0;
+        }
+        return _striped ? (page % _chips) : (page / _chipPages);
+    }
+    /**
+     * Where a page starts on its chip
+     */
+    int _chipAddress(uint16_t page)
+    {
+        if (_chips == 1) {
+            return _pageAddress(page);
+        }
+        return _pageAddress(_striped ? (page / _chips) : (page % _chipPages));
+    }
+    bool _mirrorBusy(void);
+    void _mirrorPage(uint16_t page);
+    bool _mirrorStep(void);
+    bool _crcStep(void);
+    bool _flushMirror(void);
+    void _checkMirror(void);
+    uint16_t _crcPages(void)
+    {
+        return (_lastPage() / PAGE_SIZE) + 1;
+    }
+    /**
+     * Where the page CRCs start on both chips, just past our space
+     */
+    int _crcAddress(void)
+    {
+        return _pageAddress(_lastPage() + 1);
+    }
+
+    bool _readPages(uint16_t page, uint16_t count);
+    bool _readPlan(uint16_t first, uint16_t last, PageTest test);
+    bool _loadPages(uint16_t first, uint16_t last);
+    /**
+     * Makes sure a range is in the cache after beginAsync() or a write around
+     */
+    void _load(int address, size_t size = 1)
+    {
+        if (_stale) {
+            _loadPages(_addressPage(address), _addressPage(address + size - 1));
+        }
+    }
+    uint32_t _now(void);
+    uint32_t _dirtyAge(uint16_t page)
+    {
+        return _now() - _page[page].dirtyTime;
+    }
 
     bool _goodAddress(int address, size_t size = 0)
     {
-        int addr = address + size;
-        return !((address < 0) || ((size_t)addr >= _size) || !_buffer);
+        if (size == 0) {
+            size = 1;
+        }
+        return !((address < 0) || (((size_t)address + size) > _size) || !_buffer);
+    }
+
+    bool _goodView(int address, size_t size, size_t align)
+    {
+        return _goodAddress(address, size) && ((((uintptr_t) _buffer) + address) % align == 0);
     }
 
     int _blockAddress(int block)
@@ -108,11 +636,23 @@ protected:
 
     int _addressPage(int address)
     {
-        return address / UNIO_PAGE_SIZE;
+        return address / PAGE_SIZE;
     }
     int _pageAddress(int page)
     {
-        return page * UNIO_PAGE_SIZE;
+        return page * PAGE_SIZE;
+    }
+    /**
+     * The bytes of a page inside our size.  Only the last page can be short.
+     */
+    size_t _pageBytes(uint16_t page)
+    {
+        size_t left = _size - _pageAddress(page);
+        return (left < PAGE_SIZE) ? left : (size_t) PAGE_SIZE;
+    }
+    int _lastPage(void)
+    {
+        return _addressPage(_size - 1);
     }
 
     bool _isDirty(uint16_t page)
@@ -123,11 +663,68 @@ protected:
         }
         return _dirty[index] & DIRTY_BIT(page);
     }
-    void _setDirty(uint16_t page)
+    bool _isUnloaded(uint16_t page)
+    {
+        return _unloaded[DIRTY_BYTE(page)] & DIRTY_BIT(page);
+    }
+    /**
+     * Keeps _stale set only while there are pages left to read
+     */
+    void _checkStale(void)
+    {
+        uint16_t page;
+        _stale = _loading;
+        for (page = 0; (page < _pages) && !_stale; page++) {
+            _stale = _isUnloaded(page);
+        }
+    }
+    void _setUnloaded(uint16_t page)
+    {
+        uint8_t index = DIRTY_BYTE(page);
+        if (index < _dirtySize) {
+            _unloaded[index] |= DIRTY_BIT(page);
+            _stale = true;
+        }
+    }
+    void _clearUnloaded(uint16_t page)
     {
         uint8_t index = DIRTY_BYTE(page);
         if (index < _dirtySize) {
-            _dirty[index] |= DIRTY_BIT(page);
+            _unloaded[index] &= ~DIRTY_BIT(page);
+        }
+    }
+    bool _isChanged(uint16_t page)
+    {
+        return _changed[DIRTY_BYTE(page)] & DIRTY_BIT(page);
+    }
+    void _setChanged(uint16_t page)
+    {
+        uint8_t index = DIRTY_BYTE(page);
+        if (index < _dirtySize) {
+            _changed[index] |= DIRTY_BIT(page);
+        }
+    }
+    void _clearChanged(uint16_t page)
+    {
+        uint8_t index = DIRTY_BYTE(page);
+        if (index < _dirtySize) {
+            _changed[index] &= ~DIRTY_BIT(page);
+        }
+    }
+    bool _isClean(uint16_t page)
+    {
+        return !_isDirty(page);
+    }
+    bool _isPage(uint16_t page)
+    {
+        return true;
+    }
+    void _setDirty(uint16_t page);
+    void _setDirtyRange(int address, size_t size)
+    {
+        int page;
+        for (page = _addressPage(address); page <= _addressPage(address + size - 1); page++) {
+            _setDirty(page);
         }
     }
     void _clearDirty(uint16_t page)
@@ -140,18 +737,336 @@ protected:
     /**
      * Copying not allowed
      */
-    UNIOEEPROMClass(const UNIOEEPROMClass &other)
+    UNIOEEPROMBase(const UNIOEEPROMBase &other)
     {
     }
     /**
      * Copying not allowed
      */
-    UNIOEEPROMClass &operator=(const UNIOEEPROMClass &other)
+    UNIOEEPROMBase &operator=(const UNIOEEPROMBase &other)
     {
         return *this;
     }
 
 };
 
+/**
+ * Direct write access to a T in the cache, from UNIOEEPROMBase::edit()
+ */
+template<typename T, class EEPROM>
+class UNIOEEPROMEdit {
+public:
+    UNIOEEPROMEdit(EEPROM *eeprom, int address, T *data)
+     : _eeprom(eeprom), _address(address), _data(data)
+    {
+    }
+    UNIOEEPROMEdit(UNIOEEPROMEdit &&other)
+     : _eeprom(other._eeprom), _address(other._address), _data(other._data)
+    {
+        other._data = NULL;
+    }
+    ~UNIOEEPROMEdit()
+    {
+        if (_data) {
+            _eeprom->_setDirtyRange(_address, sizeof(T));
+            _eeprom->_flushThrough();
+        }
+    }
+    bool valid() {
+        return _data != NULL;
+    }
+    T &operator*() {
+        return *_data;
+    }
+    T *operator->() {
+        return _data;
+    }
+
+private:
+    EEPROM *_eeprom = NULL;
+    int _address = 0;
+    T *_data = NULL;
+    /**
+     * Copying not allowed
+     */
+    UNIOEEPROMEdit(const UNIOEEPROMEdit &other)
+    {
+    }
+    /**
+     * Copying not allowed
+     */
+    UNIOEEPROMEdit &operator=(const UNIOEEPROMEdit &other)
+    {
+        return *this;
+    }
+};
+
+/**
+ * A T at a fixed address in the cache.  It does not compile if the T lands on
+ * more pages than it has to, since every extra page is another page write
+ * each time it changes.  Set Pages to allow that many pages.
+ *
+ *     UNIOEEPROMField<uint32_t, 16> counter(EEPROM);
+ *     counter = counter + 1;
+ *
+ * Reads and writes go straight to the cache, with the pages worked out at
+ * compile time.  Pages that are not write back, and a cache still loading,
+ * go through writeBytes().
+ */
+template<typename T, int Address, uint16_t Pages, class EEPROM>
+class UNIOEEPROMField {
+public:
+    static constexpr int address = Address;
+    static constexpr uint16_t pages = EEPROM::pagesUnder(Address, sizeof(T));
+    static_assert(Address >= 0, "The address can not be negative");
+    static_assert(pages <= (Pages ? Pages : EEPROM::fewestPages(sizeof(T))),
+                  "The field is on more pages than it needs.  Move it, or set Pages.");
+
+    UNIOEEPROMField(EEPROM &eeprom)
+     : _eeprom(eeprom)
+    {
+    }
+    T get(void)
+    {
+        T t = T();
+        return _eeprom.get(Address, t);
+    }
+    bool set(const T &t)
+    {
+        const uint8_t *data = (const uint8_t*) &t;
+        int page, chunk, offset = 0;
+        if (!_eeprom._goodAddress(Address, sizeof(T))) {
+            return false;
+        }
+        _eeprom._trace(UNIO_TRACE_PUT, Address, sizeof(T));
+        if (_eeprom._stale || !_writeBack()) {
+            return _eeprom.writeBytes(Address, data, sizeof(T));
+        }
+        for (page = _first; page < (_first + pages); page++) {
+            chunk = ((page + 1) * EEPROM::PAGE_SIZE) - (Address + offset);
+            if (chunk > ((int)sizeof(T) - offset)) {
+                chunk = sizeof(T) - offset;
+            }
+            if (memcmp(&_eeprom._buffer[Address + offset], &data[offset], chunk) != 0) {
+                _eeprom._fenceChange(page);
+                memcpy(&_eeprom._buffer[Address + offset], &data[offset], chunk);
+                _eeprom._setDirty(page);
+            }
+            offset += chunk;
+        }
+        return true;
+    }
+    operator T()
+    {
+        return get();
+    }
+    UNIOEEPROMField &operator=(const T &t)
+    {
+        set(t);
+        return *this;
+    }
+
+private:
+    static constexpr int _first = Address / EEPROM::PAGE_SIZE;
+    EEPROM &_eeprom;
+
+    bool _writeBack(void)
+    {
+        int page;
+        for (page = _first; page < (_first + pages); page++) {
+            if (_eeprom._page[page].mode != UNIO_WRITE_BACK) {
+                return false;
+            }
+        }
+        return true;
+    }
+    /**
+     * Copying not allowed
+     */
+    UNIOEEPROMField(const UNIOEEPROMField &other)
+     : _eeprom(other._eeprom)
+    {
+    }
+    /**
+     * Copying not allowed
+     */
+    UNIOEEPROMField &operator=(const UNIOEEPROMField &other)
+    {
+        return *this;
+    }
+};
+
+/**
+ * Applies a patch made by encode() to an UNIOEEPROMBase, as it comes in.
+ * The patch can be fed in pieces of any size, so it can come straight out of
+ * a serial buffer, and nothing is allocated.
+ *
+ * A patch is a list of records, starting at address 0:
+ *
+ *  - a varint with the number of bytes to skip
+ *  - a varint with the length shifted up by one.  The low bit is set for a fill
+ *  - length bytes of data, or one byte to fill with
+ *
+ * A record with a length of 0 ends the patch.  Varints are 7 bits per byte,
+ * low bits first, with the top bit set on every byte but the last.  Records
+ * are written through writeBytes() and fillRange(), so pages that do not
+ * change are not dirtied.  Records before a bad one stay applied.
+ */
+template<class EEPROM>
+class UNIOEEPROMPatchBase {
+public:
+    UNIOEEPROMPatchBase(EEPROM *eeprom)
+     : _eeprom(eeprom)
+    {
+    }
+    void reset(void);
+    bool feed(const uint8_t *data, size_t length);
+    bool done(void) {
+        return _state == _done;
+    }
+    bool failed(void) {
+        return _state == _failed;
+    }
+    static size_t encode(const uint8_t *from, const uint8_t *to, size_t length, uint8_t *patch, size_t size);
+
+private:
+    enum State { _skip, _header, _fill, _data, _done, _failed };
+    EEPROM *_eeprom = NULL;
+    State _state = _skip;
+    uint32_t _value = 0;
+    uint8_t _shift = 0;
+    uint32_t _address = 0;
+    uint32_t _count = 0;
+
+    bool _varint(uint8_t byte);
+    /**
+     * Copying not allowed
+     */
+    UNIOEEPROMPatchBase(const UNIOEEPROMPatchBase &other)
+    {
+    }
+    /**
+     * Copying not allowed
+     */
+    UNIOEEPROMPatchBase &operator=(const UNIOEEPROMPatchBase &other)
+    {
+        return *this;
+    }
+};
+
+typedef UNIOEEPROMPatchBase<UNIOEEPROMClass> UNIOEEPROMPatch;
+
+/**
+ * Keeps a header with the layout version and hash in the EEPROM, and moves
+ * the fields over to a new layout a little at a time.
+ *
+ *     UNIOEEPROMSchema schema(&EEPROM, 3, UNIOEEPROMSchema::hash("v3 layout"));
+ *     schema.addMigration(2, fromV2, 4);
+ *     EEPROM.begin();
+ *     schema.begin();
+ *     ...
+ *     schema.step();
+ *     EEPROM.commit();
+ *
+ * A migration is a list of steps that each copy, fill or transform a field.
+ * step() does one page of a step, and only when nothing is left to write, so
+ * the migration goes at the pace of commit().  After each piece the progress
+ * is saved in the header, with fence()s on both sides, so after a power cut
+ * begin() picks up from the last piece saved.  That piece is done over, so a
+ * piece has to read the same old bytes the second time: a transform can not
+ * write over its own src, and copies are cut into pieces no bigger than the
+ * distance they move.  A transform is done in one piece, so its dest has to
+ * fit in one page.  Fields moved by the migration are not ready until
+ * migrating() is false.  finish() does the rest in one go.  The header is
+ * kept twice, a page apart, and the two are written in turn.  The header
+ * address has to start a page.  Keep both pages out of the way of the
+ * migration.
+ */
+template<class EEPROM>
+class UNIOEEPROMSchemaBase {
+public:
+    /**
+     * The header takes the page at address and the one after it.  address
+     * has to start a page.
+     */
+    UNIOEEPROMSchemaBase(EEPROM *eeprom, uint16_t version, uint32_t hash, int address = 0)
+     : _eeprom(eeprom), _address(address), _version(version), _hash(hash)
+    {
+    }
+    bool addMigration(uint16_t from, const UNIOEEPROMMigration *steps, uint16_t count);
+    int begin(void);
+    bool reset(void);
+    bool step(void);
+    bool finish(void);
+    bool migrating(void) {
+        return _active >= 0;
+    }
+    bool failed(void) {
+        return _failed;
+    }
+    /**
+     * The version found by begin(), or the one being migrated from
+     */
+    uint16_t found(void) {
+        return _found;
+    }
+    /**
+     * FNV-1a, for making a layout hash out of a string at compile time
+     */
+    static constexpr uint32_t hash(const char *text, uint32_t value = 2166136261UL) {
+        return (*text == 0) ? value : hash(text + 1, (value ^ (uint8_t)*text) * 16777619UL);
+    }
+
+private:
+    EEPROM *_eeprom = NULL;
+    int _address = 0;
+    uint16_t _version = 0;
+    uint32_t _hash = 0;
+    uint16_t _found = 0;
+    const UNIOEEPROMMigration *_steps[UNIO_EEPROM_MIGRATIONS] = { NULL };
+    uint16_t _count[UNIO_EEPROM_MIGRATIONS] = { 0 };
+    uint16_t _from[UNIO_EEPROM_MIGRATIONS] = { 0 };
+    uint8_t _migrations = 0;
+    int8_t _active = -1;
+    uint16_t _step = 0;
+    uint16_t _done = 0;
+    uint8_t _serial = 0;
+    bool _failed = false;
+
+    bool _aligned(void)
+    {
+        return (_address >= 0) && ((_address % EEPROM::PAGE_SIZE) == 0);
+    }
+    int _headerAddress(uint8_t copy)
+    {
+        if ((copy & 1) == 0) {
+            return _address;
+        }
+        return _address + ((EEPROM::PAGE_SIZE > UNIO_SCHEMA_HEADER) ? (int)EEPROM::PAGE_SIZE : UNIO_SCHEMA_HEADER);
+    }
+    bool _readHeader(uint8_t copy, uint8_t *header);
+    bool _writeHeader(uint16_t from);
+    uint16_t _piece(const UNIOEEPROMMigration &step);
+    /**
+     * Copying not allowed
+     */
+    UNIOEEPROMSchemaBase(const UNIOEEPROMSchemaBase &other)
+    {
+    }
+    /**
+     * Copying not allowed
+     */
+    UNIOEEPROMSchemaBase &operator=(const UNIOEEPROMSchemaBase &other)
+    {
+        return *this;
+    }
+};
+
+typedef UNIOEEPROMSchemaBase<UNIOEEPROMClass> UNIOEEPROMSchema;
+
+extern template class UNIOEEPROMBase<UNIO>;
+extern template class UNIOEEPROMPatchBase<UNIOEEPROMClass>;
+extern template class UNIOEEPROMSchemaBase<UNIOEEPROMClass>;
+
 #endif // UNIO_EEPROM_H
 
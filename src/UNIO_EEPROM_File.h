@@ -0,0 +1,289 @@
+/*
+  UNIO_EEPROM_File.h - Files on the host as devices for UNIOEEPROMBase
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef UNIO_EEPROM_File_h
+#define UNIO_EEPROM_File_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "UNIO_EEPROM.h"
+
+/**
+ * Keeps a device image in a file, for tools and tests on the host.  PageSize
+ * is the page size of the part being imaged, so the cache works the same way
+ * it does on the part.  Writes go straight to the file, so there is never a
+ * write cycle to wait for.
+ *
+ *     UNIOEEPROMFile<32> file("image.bin", 4096);
+ *     UNIOEEPROMBase<UNIOEEPROMFile<32> > eeprom(&file, 4096);
+ */
+template<uint16_t PageSize = UNIO_PAGE_SIZE>
+class UNIOEEPROMFile {
+public:
+    static const uint16_t page_size = PageSize;
+    uint32_t writecounter = 0;
+
+    /**
+     * Opens the image, or makes a blank one.  A short image is padded out to
+     * size with 0xFF, like a new part.
+     */
+    UNIOEEPROMFile(const char *name, uint32_t size)
+     : _size(size)
+    {
+        uint8_t blank = 0xFF;
+        long end;
+        _file = fopen(name, "r+b");
+        if (!_file) {
+            _file = fopen(name, "w+b");
+        }
+        if (_file && (fseek(_file, 0, SEEK_END) == 0)) {
+            for (end = ftell(_file); (end >= 0) && ((uint32_t)end < _size); end++) {
+                fwrite(&blank, 1, 1, _file);
+            }
+            fflush(_file);
+        }
+    }
+    ~UNIOEEPROMFile()
+    {
+        if (_file) {
+            fclose(_file);
+        }
+    }
+    bool isOpen(void)
+    {
+        return _file != NULL;
+    }
+
+    bool read(uint8_t *buffer, uint32_t address, uint32_t length)
+    {
+        if (!_file || ((address + length) > _size) || (fseek(_file, address, SEEK_SET) != 0)) {
+            return false;
+        }
+        return fread(buffer, 1, length, _file) == length;
+    }
+    /**
+     * Writes inside one page, like the part.  enable_write() has to be
+     * called first.
+     */
+    bool start_write(const uint8_t *buffer, uint32_t address, uint32_t length)
+    {
+        bool ret;
+        if (!_file || !_wenable || ((address + length) > _size)
+            || ((address / PageSize) != ((address + length - 1) / PageSize))
+            || (fseek(_file, address, SEEK_SET) != 0)) {
+            return false;
+        }
+        ret = (fwrite(buffer, 1, length, _file) == length) && (fflush(_file) == 0);
+        _wenable = false;
+        writecounter++;
+        return ret;
+    }
+    bool enable_write(void)
+    {
+        _wenable = (_file != NULL);
+        return _wenable;
+    }
+    bool disable_write(void)
+    {
+        _wenable = false;
+        return true;
+    }
+    bool is_writing(void)
+    {
+        return false;
+    }
+    bool simple_write(const uint8_t *buffer, uint32_t address, uint32_t length)
+    {
+        return enable_write() && start_write(buffer, address, length);
+    }
+
+private:
+    FILE *_file = NULL;
+    uint32_t _size = 0;
+    bool _wenable = false;
+    /**
+     * Copying not allowed
+     */
+    UNIOEEPROMFile(const UNIOEEPROMFile &other)
+    {
+    }
+    /**
+     * Copying not allowed
+     */
+    UNIOEEPROMFile &operator=(const UNIOEEPROMFile &other)
+    {
+        return *this;
+    }
+};
+
+/**
+ * Keeps a device image in a file mapped into memory.  Page writes are copied
+ * straight into the mapping, and synced to the file when the write cycle
+ * ends, which is the next time is_writing() is asked.  The image outlives the
+ * process, so a reboot is a new process calling begin() on the same file, and
+ * other tools can look at it with data() or read the file.
+ */
+template<uint16_t PageSize = UNIO_PAGE_SIZE>
+class UNIOEEPROMMap {
+public:
+    static const uint16_t page_size = PageSize;
+    uint32_t writecounter = 0;
+
+    /**
+     * Maps the image, or makes a blank one.  A short image is padded out to
+     * size with 0xFF, like a new part.
+     */
+    UNIOEEPROMMap(const char *name, uint32_t size)
+     : _size(size)
+    {
+        struct stat st;
+        off_t old = 0;
+        void *map;
+        int fd = open(name, O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            return;
+        }
+        if ((fstat(fd, &st) == 0) && (st.st_size < (off_t)size)) {
+            old = st.st_size;
+            if (ftruncate(fd, size) != 0) {
+                close(fd);
+                return;
+            }
+        } else {
+            old = size;
+        }
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) {
+            return;
+        }
+        _map = (uint8_t *)map;
+        if (old < (off_t)size) {
+            memset(&_map[old], 0xFF, size - old);
+            msync(_map, size, MS_SYNC);
+        }
+    }
+    ~UNIOEEPROMMap()
+    {
+        if (_map) {
+            _sync();
+            munmap(_map, _size);
+        }
+    }
+    bool isOpen(void)
+    {
+        return _map != NULL;
+    }
+    /**
+     * The image itself
+     */
+    const uint8_t *data(void)
+    {
+        return _map;
+    }
+
+    bool read(uint8_t *buffer, uint32_t address, uint32_t length)
+    {
+        if (!_map || ((address + length) > _size)) {
+            return false;
+        }
+        memcpy(buffer, &_map[address], length);
+        return true;
+    }
+    /**
+     * Writes inside one page, like the part.  enable_write() has to be
+     * called first.
+     */
+    bool start_write(const uint8_t *buffer, uint32_t address, uint32_t length)
+    {
+        if (!_map || !_wenable || ((address + length) > _size)
+            || ((address / PageSize) != ((address + length - 1) / PageSize))) {
+            return false;
+        }
+        _sync();
+        memcpy(&_map[address], buffer, length);
+        _start = address;
+        _length = length;
+        _wenable = false;
+        writecounter++;
+        return true;
+    }
+    bool enable_write(void)
+    {
+        _wenable = (_map != NULL);
+        return _wenable;
+    }
+    bool disable_write(void)
+    {
+        _wenable = false;
+        return true;
+    }
+    /**
+     * Ends the write cycle by syncing the page to the file
+     */
+    bool is_writing(void)
+    {
+        _sync();
+        return false;
+    }
+    bool simple_write(const uint8_t *buffer, uint32_t address, uint32_t length)
+    {
+        return enable_write() && start_write(buffer, address, length) && !is_writing();
+    }
+
+private:
+    uint8_t *_map = NULL;
+    uint32_t _size = 0;
+    uint32_t _start = 0;
+    uint32_t _length = 0;
+    bool _wenable = false;
+
+    /**
+     * Syncs the last page written.  msync() wants a page aligned address.
+     */
+    void _sync(void)
+    {
+        uintptr_t page = sysconf(_SC_PAGESIZE);
+        uintptr_t start = (uintptr_t)&_map[_start] & ~(page - 1);
+        if (_length > 0) {
+            msync((void *)start, ((uintptr_t)&_map[_start] - start) + _length, MS_SYNC);
+            _length = 0;
+        }
+    }
+    /**
+     * Copying not allowed
+     */
+    UNIOEEPROMMap(const UNIOEEPROMMap &other)
+    {
+    }
+    /**
+     * Copying not allowed
+     */
+    UNIOEEPROMMap &operator=(const UNIOEEPROMMap &other)
+    {
+        return *this;
+    }
+};
+
+#endif // UNIO_EEPROM_File_h
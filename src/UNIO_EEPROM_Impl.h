@@ -0,0 +1,1936 @@
+/*
+  UNIO_EEPROM_Impl.h - UNIO_EEPROM code for any device type
+
+  Copyright (c) 2014 Ivan Grokhotkov. All rights reserved.
+  This file is part of the esp8266 core for Arduino environment.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef UNIO_EEPROM_Impl_h
+#define UNIO_EEPROM_Impl_h
+
+#include "Arduino.h"
+#include "UNIO_EEPROM.h"
+
+/**
+ * Helpers for the code below.  They are kept out of the global namespace, as
+ * this header is included by user code.
+ */
+namespace UNIOEEPROMDetail {
+
+/**
+ * Word used for the bulk compares.  This is 32 bits on the M0 and 64 bits on
+ * most hosts, where the compiler is also free to vectorize the loops.
+ */
+typedef size_t __attribute__((__may_alias__)) Word;
+
+static inline bool testBit(const uint8_t *map, uint16_t bit)
+{
+    return map[DIRTY_BYTE(bit)] & DIRTY_BIT(bit);
+}
+
+static inline void setBit(uint8_t *map, uint16_t bit)
+{
+    map[DIRTY_BYTE(bit)] |= DIRTY_BIT(bit);
+}
+
+static inline void clearBit(uint8_t *map, uint16_t bit)
+{
+    map[DIRTY_BYTE(bit)] &= ~DIRTY_BIT(bit);
+}
+
+/**
+ * CRC-8 with polynomial 0x07, for the mirror page checks
+ */
+static inline uint8_t crc8(const uint8_t *data, size_t length)
+{
+    uint8_t crc = 0;
+    uint8_t bit;
+    for (; length > 0; length--) {
+        crc ^= *data++;
+        for (bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+static inline bool wordAligned(const void *ptr)
+{
+    return ((uintptr_t) ptr % sizeof(Word)) == 0;
+}
+
+/**
+ * Returns true if the two runs of bytes are the same
+ */
+static inline bool sameBytes(const uint8_t *a, const uint8_t *b, size_t length)
+{
+    if (wordAligned(a) && wordAligned(b)) {
+        const Word *wa = (const Word *) a;
+        const Word *wb = (const Word *) b;
+        for (; length >= sizeof(Word); length -= sizeof(Word)) {
+            if (*wa++ != *wb++) {
+                return false;
+            }
+        }
+        a = (const uint8_t *) wa;
+        b = (const uint8_t *) wb;
+    }
+    for (; length > 0; length--) {
+        if (*a++ != *b++) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Returns true if every byte in the run is value
+ */
+static inline bool sameValue(const uint8_t *a, uint8_t value, size_t length)
+{
+    if (wordAligned(a)) {
+        Word pattern;
+        const Word *wa = (const Word *) a;
+        memset(&pattern, value, sizeof(pattern));
+        for (; length >= sizeof(Word); length -= sizeof(Word)) {
+            if (*wa++ != pattern) {
+                return false;
+            }
+        }
+        a = (const uint8_t *) wa;
+    }
+    for (; length > 0; length--) {
+        if (*a++ != value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+template<class Device>
+UNIOEEPROMBase<Device>::UNIOEEPROMBase(Device *unio, size_t size, uint8_t blockSize)
+ : _free(false), _unio(unio), _size(size), _blockSize(blockSize)
+{
+    _init();
+}
+template<class Device>
+UNIOEEPROMBase<Device>::UNIOEEPROMBase(unsigned int address, size_t size, uint8_t blockSize)
+ : _free(true), _unio(new Device((uint8_t)address)), _size(size), _blockSize(blockSize)
+{
+    _init();
+}
+template<class Device>
+void UNIOEEPROMBase<Device>::_init(void) {
+    uint8_t chip;
+    // The last page can be short
+    _pages = (_size + PAGE_SIZE - 1) / PAGE_SIZE;
+    // One bit a page
+    _dirtySize = (_pages / 8) + 1;
+    _writePage = 0;
+    _chip[0] = _unio;
+    _chipPages = _lastPage() + 1;
+    for (chip = 0; chip < UNIO_EEPROM_CHIPS; chip++) {
+        _writing[chip] = -1;
+    }
+    if (_blockSize > _size) {
+        _blockSize = _size;
+    }
+    if (_size > 0) {
+        _buffer = new uint8_t[_size];
+    }
+    _dirty = new uint8_t[_dirtySize];
+    memset(_dirty, 0, _dirtySize);
+    _unloaded = new uint8_t[_dirtySize];
+    memset(_unloaded, 0, _dirtySize);
+    _changed = new uint8_t[_dirtySize];
+    memset(_changed, 0, _dirtySize);
+    _page = new UNIOEEPROMPage[_pages];
+    memset(_page, 0, sizeof(UNIOEEPROMPage) * _pages);
+}
+
+template<class Device>
+UNIOEEPROMBase<Device>::~UNIOEEPROMBase()
+{
+    end();
+    if (_free) {
+        delete _unio;
+    }
+    delete [] _buffer;
+    delete [] _dirty;
+    delete [] _unloaded;
+    delete [] _changed;
+    delete [] _page;
+    delete [] _crc;
+    delete [] _mirrorPending;
+    delete [] _crcPrimary;
+    delete [] _crcMirror;
+    _buffer = NULL;
+}
+
+template<class Device>
+void UNIOEEPROMBase<Device>::begin(void) {
+    // Read out the E2
+    _loading = false;
+    _stale = false;
+    if (_size > 0) {
+        _readPlan(0, _lastPage(), &UNIOEEPROMBase::_isPage);
+    }
+    memset(_unloaded, 0, _dirtySize);
+    if (_mirror) {
+        _checkMirror();
+    }
+}
+
+/**
+ * Starts loading the cache without blocking.  poll() then reads chunk bytes
+ * each time it is called.  Anything that touches a page before the sweep gets
+ * to it reads just that page first.
+ *
+ * With a mirror this is begin(), as the pages have to be checked against
+ * their CRCs before anything uses them.
+ */
+template<class Device>
+void UNIOEEPROMBase<Device>::beginAsync(uint16_t chunk) {
+    if (_mirror) {
+        begin();
+        return;
+    }
+    if (_size == 0) {
+        return;
+    }
+    memset(_unloaded, 0xFF, _dirtySize);
+    _loadChunk = (chunk < PAGE_SIZE) ? (uint16_t) PAGE_SIZE : chunk;
+    _loadPage = 0;
+    _loading = true;
+    _stale = true;
+}
+
+/**
+ * Loads the next chunk after beginAsync().  It does nothing while the device
+ * is busy writing.
+ *
+ * Returns true once the whole cache is loaded
+ */
+template<class Device>
+bool UNIOEEPROMBase<Device>::poll(void) {
+    uint32_t last;
+    if (!_loading) {
+        return true;
+    }
+    if (_writeBusy()) {
+        return false;
+    }
+    last = _loadPage + (_loadChunk / PAGE_SIZE) - 1;
+    if (last > (uint32_t)_lastPage()) {
+        last = _lastPage();
+    }
+    _loadPages(_loadPage, last);
+    _loadPage = last + 1;
+    if (_loadPage > _lastPage()) {
+        _loading = false;
+        // Pages dropped by write around behind the sweep are still stale
+        _checkStale();
+    }
+    return !_loading;
+}
+
+/**
+ * Reads any pages from first to last that are not loaded yet
+ */
+template<class Device>
+bool UNIOEEPROMBase<Device>::_loadPages(uint16_t first, uint16_t last) {
+    uint16_t page;
+    bool ret;
+    for (page = first; (page <= last) && !_isUnloaded(page); page++);
+    if (page > last) {
+        return true;
+    }
+    // The device does not answer reads during a write cycle
+    _writeWait();
+    ret = _readPlan(page, last, &UNIOEEPROMBase::_isUnloaded);
+    for (; page <= last; page++) {
+        _clearUnloaded(page);
+    }
+    _checkStale();
+    return ret;
+}
+
+/**
+ * Reads count pages starting at page from the device into the cache
+ */
+template<class Device>
+bool UNIOEEPROMBase<Device>::_readPages(uint16_t page, uint16_t count) {
+    uint32_t end, last = page + count;
+    size_t start, stop;
+    bool ret = true;
+    for (; page < last; page = end) {
+        // Pages that follow each other on the same chip go in one read
+        for (end = page + 1; (end < last) && (_chipOf(end) == _chipOf(page))
+            && (_chipAddress(end) == _chipAddress(end - 1) + PAGE_SIZE); end++);
+        start = _pageAddress(page);
+        stop = _pageAddress(end);
+        if (stop > _size) {
+            stop = _size;
+        }
+        if (start < stop) {
+            ret = _chip[_chipOf(page)]->read(&_buffer[start], _chipAddress(page), stop - start) && ret;
+        }
+    }
+    return ret;
+}
+
+/**
+ * Reads the pages from first to last that test picks.  Every read has a
+ * standby pulse, header, device address, command and address before any data
+ * moves, so adjacent pages are merged into as few reads as _maxReadChunk
+ * allows.
+ */
+template<class Device>
+bool UNIOEEPROMBase<Device>::_readPlan(uint16_t first, uint16_t last, PageTest test) {
+    uint32_t page, end, limit;
+    uint32_t chunk = _maxReadChunk / PAGE_SIZE;
+    bool ret = true;
+    if ((chunk == 0) && (_maxReadChunk > 0)) {
+        chunk = 1;
+    }
+    for (page = first; page <= last; page = end) {
+        end = page + 1;
+        if ((this->*test)(page)) {
+            limit = (chunk > 0) ? page + chunk : last + 1;
+            for (; (end <= last) && (end < limit) && (this->*test)(end); end++);
+            ret = _readPages(page, end - page) && ret;
+        }
+    }
+    return ret;
+}
+
+/**
+ * Throws away every change that has not been written yet
+ */
+template<class Device>
+bool UNIOEEPROMBase<Device>::discard(void) {
+    return discardRange(0, _size);
+}
+
+/**
+ * Throws away the changes in a range that have not been written yet.  This
+ * works on whole pages, so the rest of any page the range touches is
+ * reverted as well.  Only the dirty pages are read back, with one read for
+ * each run of them.
+ */
+template<class Device>
+bool UNIOEEPROMBase<Device>::discardRange(int address, size_t length) {
+    uint16_t page, first, last;
+    bool ret;
+    if (!_goodAddress(address, length) || (length == 0)) {
+        return false;
+    }
+    first = _addressPage(address);
+    last = _addressPage(address + length - 1);
+    // The device does not answer reads during a write cycle
+    _writeWait();
+    ret = _readPlan(first, last, &UNIOEEPROMBase::_isDirty);
+    for (page = first; page <= last; page++) {
+        if (_isDirty(page)) {
+            // A replica may already have the change we just threw away
+            _setChanged(page);
+        }
+        _clearDirty(page);
+    }
+    return ret;
+}
+
+/**
+ * Reads a range back from the device after something else has written it.
+ * This works on whole pages.  policy says what to do with dirty pages in the
+ * range; see UNIO_RELOAD_*.
+ *
+ * Returns the number of dirty pages in the range, or -1 on error
+ */
+template<class Device>
+int UNIOEEPROMBase<Device>::reload(int address, size_t length, uint8_t policy) {
+    uint16_t page, first, last;
+    int dirty = 0;
+    if (!_goodAddress(address, length) || (length == 0)) {
+        return -1;
+    }
+    first = _addressPage(address);
+    last = _addressPage(address + length - 1);
+    for (page = first; page <= last; page++) {
+        if (_isDirty(page)) {
+            dirty++;
+            if (policy == UNIO_RELOAD_DEVICE) {
+                _clearDirty(page);
+            }
+        }
+    }
+    if ((dirty > 0) && (policy == UNIO_RELOAD_CONFLICT)) {
+        return dirty;
+    }
+    // The device does not answer reads during a write cycle
+    _writeWait();
+    // One read for each run of clean pages, which is one read unless we are
+    // keeping some dirty pages.
+    if (!_readPlan(first, last, &UNIOEEPROMBase::_isClean)) {
+        return -1;
+    }
+    for (page = first; page <= last; page++) {
+        _clearUnloaded(page);
+        if (!_isDirty(page)) {
+            _setChanged(page);
+        }
+    }
+    return dirty;
+}
+
+template<class Device>
+void UNIOEEPROMBase<Device>::end(void) {
+    // Commit any changes before we end
+    flush();
+}
+
+
+template<class Device>
+uint8_t UNIOEEPROMBase<Device>::read(int address) {
+    if (!_goodAddress(address)) {
+        return 0;
+    }
+    _trace(UNIO_TRACE_READ, address, 1);
+    _load(address);
+    return _buffer[address];
+}
+
+template<class Device>
+void UNIOEEPROMBase<Device>::write(int address, uint8_t value) {
+    if (!_goodAddress(address)) {
+        return;
+    }
+    _trace(UNIO_TRACE_WRITE, address, 1);
+    if (_page[_addressPage(address)].mode != UNIO_WRITE_BACK) {
+        writeBytes(address, &value, 1);
+        return;
+    }
+    _load(address);
+
+    // Optimise _dirty. Only flagged if data written is different.
+    uint8_t* data = &_buffer[address];
+    if (*data != value)
+    {
+        _fenceChange(_addressPage(address));
+        *data = value;
+        _setDirty(_addressPage(address));
+    }
+}
+
+template<class Device>
+bool UNIOEEPROMBase<Device>::readBlock(int block, uint8_t *buffer) {
+    int address = _blockAddress(block);
+    if (!_goodAddress(address, _blockSize) || !buffer || (_blockSize == 0)) {
+        return false;
+    }
+    _load(address, _blockSize);
+    memcpy(buffer, &_buffer[address], _blockSize);
+    return true;
+}
+
+template<class Device>
+bool UNIOEEPROMBase<Device>::writeBlock(int block, uint8_t *buffer) {
+    int address = _blockAddress(block);
+    if (!_goodAddress(address, _blockSize) || !buffer || (_blockSize == 0)) {
+        return false;
+    }
+    _trace(UNIO_TRACE_BLOCK, address, _blockSize);
+    return writeBytes(address, buffer, _blockSize);
+}
+
+template<class Device>
+bool UNIOEEPROMBase<Device>::copyBlock(int dest, int src) {
+    int address = _blockAddress(src);
+    if (!_goodAddress(address, _blockSize)) {
+        return false;
+    }
+    _load(address, _blockSize);
+    return writeBlock(dest, &_buffer[address]);
+}
+
+template<class Device>
+uint32_t UNIOEEPROMBase<Device>::_now(void) {
+    return millis();
+}
+
+#ifdef UNIO_EEPROM_TRACE
+template<class Device>
+void UNIOEEPROMBase<Device>::_trace(uint8_t event, int address, size_t length) {
+    uint8_t *record;
+    uint32_t now = _now();
+    if (_traceCount == UNIO_EEPROM_TRACE) {
+        // Drop the oldest
+        _traceHead = (_traceHead + 1) % UNIO_EEPROM_TRACE;
+        _traceCount--;
+        _traceLost++;
+    }
+    record = &_traceBuffer[((_traceHead + _traceCount) % UNIO_EEPROM_TRACE) * UNIO_TRACE_RECORD];
+    record[0] = event;
+    record[1] = (length > 0xFF) ? 0xFF : length;
+    record[2] = address & 0xFF;
+    record[3] = (address >> 8) & 0xFF;
+    record[4] = now & 0xFF;
+    record[5] = (now >> 8) & 0xFF;
+    record[6] = (now >> 16) & 0xFF;
+    record[7] = (now >> 24) & 0xFF;
+    _traceCount++;
+}
+/**
+ * Moves the oldest events in the trace into buffer, UNIO_TRACE_RECORD bytes
+ * each.  Only whole events are moved.
+ *
+ * Returns the number of bytes put in buffer
+ */
+template<class Device>
+size_t UNIOEEPROMBase<Device>::traceRead(uint8_t *buffer, size_t length) {
+    size_t ret = 0;
+    if (!buffer) {
+        return 0;
+    }
+    while ((_traceCount > 0) && ((ret + UNIO_TRACE_RECORD) <= length)) {
+        memcpy(&buffer[ret], &_traceBuffer[_traceHead * UNIO_TRACE_RECORD], UNIO_TRACE_RECORD);
+        _traceHead = (_traceHead + 1) % UNIO_EEPROM_TRACE;
+        _traceCount--;
+        ret += UNIO_TRACE_RECORD;
+    }
+    return ret;
+}
+#endif
+
+template<class Device>
+void UNIOEEPROMBase<Device>::_setDirty(uint16_t page) {
+    uint8_t index = DIRTY_BYTE(page);
+    if (index < _dirtySize) {
+        _sequence++;
+        _page[page].epoch = _epoch;
+        if (_page[page].mode == UNIO_WRITE_THROUGH) {
+            _through = true;
+        }
+        _changed[index] |= DIRTY_BIT(page);
+        if (!(_dirty[index] & DIRTY_BIT(page))) {
+            // Only stamp the page when it goes from clean to dirty
+            _page[page].dirtyTime = _now();
+            _page[page].dirtySeq = _sequence;
+            _dirty[index] |= DIRTY_BIT(page);
+        }
+    }
+}
+
+template<class Device>
+bool UNIOEEPROMBase<Device>::addCallback(UNIOEEPROMCallback callback, void *arg) {
+    uint8_t index;
+    for (index = 0; index < UNIO_EEPROM_CALLBACKS; index++) {
+        if (_callback[index] == NULL) {
+            _callback[index] = callback;
+            _callbackArg[index] = arg;
+            return true;
+        }
+    }
+    return false;
+}
+
+template<class Device>
+void UNIOEEPROMBase<Device>::removeCallback(UNIOEEPROMCallback callback) {
+    uint8_t index;
+    for (index = 0; index < UNIO_EEPROM_CALLBACKS; index++) {
+        if (_callback[index] == callback) {
+            _callback[index] = NULL;
+        }
+    }
+}
+
+template<class Device>
+void UNIOEEPROMBase<Device>::_event(uint8_t event, int page) {
+    uint8_t index;
+    uint32_t time = _now();
+    for (index = 0; index < UNIO_EEPROM_CALLBACKS; index++) {
+        if (_callback[index] != NULL) {
+            _callback[index](event, page, time, _callbackArg[index]);
+        }
+    }
+}
+
+/**
+ * Marks the write in flight on a chip as finished
+ */
+template<class Device>
+void UNIOEEPROMBase<Device>::_writeDone(uint8_t chip) {
+    _busy &= ~(1 << chip);
+    if (_writing[chip] >= 0) {
+        int page = _writing[chip];
+        _writing[chip] = -1;
+        _event(UNIO_EVENT_WRITE_DONE, page);
+    }
+}
+
+/**
+ * Returns true while our last write to a chip is still in its write cycle.
+ * The chip is only asked if we started a write on it.
+ */
+template<class Device>
+bool UNIOEEPROMBase<Device>::_writeBusy(uint8_t chip) {
+    if (!(_busy & (1 << chip))) {
+        return false;
+    }
+    if (_chip[chip]->is_writing()) {
+        return true;
+    }
+    _writeDone(chip);
+    return false;
+}
+
+/**
+ * Returns true while any chip is in a write cycle we started
+ */
+template<class Device>
+bool UNIOEEPROMBase<Device>::_writeBusy(void) {
+    uint8_t chip;
+    bool busy = false;
+    for (chip = 0; chip < _chips; chip++) {
+        busy = _writeBusy(chip) || busy;
+    }
+    return busy;
+}
+
+/**
+ * Waits for every chip to finish any write cycle
+ */
+template<class Device>
+void UNIOEEPROMBase<Device>::_writeWait(void) {
+    uint8_t chip;
+    for (chip = 0; chip < _chips; chip++) {
+        while (_chip[chip]->is_writing());
+        _writeDone(chip);
+    }
+}
+
+/**
+ * Returns the last sequence() where it and every change before it are on the
+ * chip
+ */
+template<class Device>
+uint32_t UNIOEEPROMBase<Device>::durableSequence(void) {
+    uint16_t index;
+    uint32_t oldest = _sequence + 1;
+    for (index = 0; index < _pages; index++) {
+        if (_isDirty(index) && (_page[index].dirtySeq < oldest)) {
+            oldest = _page[index].dirtySeq;
+        }
+    }
+    for (index = 0; index < _chips; index++) {
+        if ((_writing[index] >= 0) && (_writingSeq[index] < oldest)) {
+            oldest = _writingSeq[index];
+        }
+    }
+    return oldest - 1;
+}
+
+/**
+ * Runs commit() until seq is on the chip.  Returns false if a write fails.
+ */
+template<class Device>
+bool UNIOEEPROMBase<Device>::waitDurable(uint32_t seq) {
+    while (durableSequence() < seq) {
+        if ((!commit() && !_busy) || (quarantined() > 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Returns the oldest epoch that still has dirty pages.  Only those pages can
+ * be written.
+ */
+template<class Device>
+uint16_t UNIOEEPROMBase<Device>::_firstEpoch(void) {
+    uint16_t index;
+    uint16_t age;
+    if (_drainEpoch == _epoch) {
+        return _drainEpoch;
+    }
+    // Epochs only go up, so the oldest one is the furthest behind _epoch
+    age = 0;
+    for (index = 0; index < _pages; index++) {
+        if (_isDirty(index) && ((uint16_t)(_epoch - _page[index].epoch) > age)) {
+            age = _epoch - _page[index].epoch;
+        }
+    }
+    _drainEpoch = _epoch - age;
+    return _drainEpoch;
+}
+
+/**
+ * Returns true while a write from an epoch before epoch is still in its write
+ * cycle on any chip.  Nothing from epoch can start until it is done.
+ */
+template<class Device>
+bool UNIOEEPROMBase<Device>::_olderInFlight(uint16_t epoch) {
+    uint8_t chip;
+    bool busy = false;
+    for (chip = 0; chip < _chips; chip++) {
+        if ((_writing[chip] >= 0) && ((int16_t)(epoch - _writingEpoch[chip]) > 0)) {
+            busy = _writeBusy(chip) || busy;
+        }
+    }
+    return busy;
+}
+
+/**
+ * Counts a failed write, and backs the page off for twice as many commit()
+ * calls each time it fails in a row
+ */
+template<class Device>
+void UNIOEEPROMBase<Device>::_writeFailed(uint16_t page) {
+    uint8_t failures = _page[page].failures;
+    _failures++;
+    if (failures < 0xFF) {
+        failures++;
+    }
+    _page[page].failures = failures;
+    _page[page].retryAt = _commits + (1 << ((failures < 10) ? failures : 10));
+}
+
+template<class Device>
+uint16_t UNIOEEPROMBase<Device>::quarantined(void) {
+    uint16_t index;
+    uint16_t count = 0;
+    for (index = 0; index < _pages; index++) {
+        if (isQuarantined(index)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * Lets quarantined and backed off pages be tried again straight away
+ */
+template<class Device>
+void UNIOEEPROMBase<Device>::clearFailures(void) {
+    uint16_t index;
+    for (index = 0; index < _pages; index++) {
+        _page[index].failures = 0;
+        _page[index].retryAt = _commits;
+    }
+}
+
+template<class Device>
+int UNIOEEPROMBase<Device>::oldestDirtyPage(void) {
+    return _oldestDirty(false);
+}
+
+/**
+ * Finds the page that has been dirty the longest.  If ordered is set, only
+ * the pages fence() lets us write now are looked at.
+ */
+template<class Device>
+int UNIOEEPROMBase<Device>::_oldestDirty(bool ordered) {
+    uint16_t index;
+    uint16_t epoch = _firstEpoch();
+    int oldest = -1;
+    uint32_t age = 0;
+    for (index = 0; index < _pages; index++) {
+        if ((ordered ? _canWrite(index, epoch) : _isDirty(index)) && ((oldest < 0) || (_dirtyAge(index) > age))) {
+            oldest = index;
+            age = _dirtyAge(index);
+        }
+    }
+    return oldest;
+}
+
+template<class Device>
+uint32_t UNIOEEPROMBase<Device>::maxDirtyAge(void) {
+    int page = oldestDirtyPage();
+    if (page < 0) {
+        return 0;
+    }
+    return _dirtyAge(page);
+}
+
+template<class Device>
+bool UNIOEEPROMBase<Device>::readBytes(int address, uint8_t *buffer, size_t length) {
+    if (!_goodAddress(address, length) || !buffer || (length == 0)) {
+        return false;
+    }
+    _load(address, length);
+    memcpy(buffer, &_buffer[address], length);
+    return true;
+}
+
+template<class Device>
+bool UNIOEEPROMBase<Device>::writeBytes(int address, const uint8_t *data, size_t length) {
+    size_t chunk;
+    uint16_t page;
+    if (!_goodAddress(address, length) || !data || (length == 0)) {
+        return false;
+    }
+    // Go a page at a time, so each page is compared and dirtied once
+    while (length > 0) {
+        chunk = PAGE_SIZE - (address % PAGE_SIZE);
+        if (chunk > length) {
+            chunk = length;
+        }
+        page = _addressPage(address);
+        if (_page[page].mode == UNIO_WRITE_AROUND) {
+            // Reading the page back costs less than a write cycle
+            _load(address, chunk);
+        }
+        if (!_isUnloaded(page) && UNIOEEPROMDetail::sameBytes(&_buffer[address], data, chunk)) {
+            // Nothing to do
+        } else if ((_page[page].mode == UNIO_WRITE_AROUND) && _writeAround(address, data, chunk)) {
+            // Went straight to the device
+        } else {
+            _load(address, chunk);
+            if (!UNIOEEPROMDetail::sameBytes(&_buffer[address], data, chunk)) {
+                _fenceChange(page);
+                memcpy(&_buffer[address], data, chunk);
+                _setDirty(page);
+            }
+        }
+        address += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+    _flushThrough();
+    return true;
+}
+
+template<class Device>
+bool UNIOEEPROMBase<Device>::fill(int address, uint8_t value, size_t length) {
+    return fillRange(address, value, length) >= 0;
+}
+
+/**
+ * Sets a range to value.  Pages already holding value are left clean.
+ *
+ * Returns the number of pages skipped, or -1 if the range is bad
+ */
+template<class Device>
+int UNIOEEPROMBase<Device>::fillRange(int address, uint8_t value, size_t length) {
+    size_t chunk;
+    uint16_t page;
+    uint8_t fill[PAGE_SIZE];
+    int skipped = 0;
+    if (!_goodAddress(address, length) || (length == 0)) {
+        return -1;
+    }
+    memset(fill, value, sizeof(fill));
+    while (length > 0) {
+        chunk = PAGE_SIZE - (address % PAGE_SIZE);
+        if (chunk > length) {
+            chunk = length;
+        }
+        page = _addressPage(address);
+        if (_page[page].mode == UNIO_WRITE_AROUND) {
+            // Reading the page back costs less than a write cycle
+            _load(address, chunk);
+        }
+        if (!_isUnloaded(page) && UNIOEEPROMDetail::sameValue(&_buffer[address], value, chunk)) {
+            skipped++;
+        } else if ((_page[page].mode == UNIO_WRITE_AROUND) && _writeAround(address, fill, chunk)) {
+            // Went straight to the device
+        } else {
+            _load(address, chunk);
+            if (UNIOEEPROMDetail::sameValue(&_buffer[address], value, chunk)) {
+                skipped++;
+            } else {
+                _fenceChange(page);
+                memset(&_buffer[address], value, chunk);
+                _setDirty(page);
+            }
+        }
+        address += chunk;
+        length -= chunk;
+    }
+    _flushThrough();
+    return skipped;
+}
+
+/**
+ * Sets the whole device to value.  With the default of 0xFF, pages that are
+ * still fresh from the factory are never rewritten.
+ *
+ * Returns the number of pages skipped, or -1 if there is no cache
+ */
+template<class Device>
+int UNIOEEPROMBase<Device>::clear(uint8_t value) {
+    return fillRange(0, value, _size);
+}
+
+template<class Device>
+bool UNIOEEPROMBase<Device>::equals(int address, const uint8_t *data, size_t length) {
+    if (!_goodAddress(address, length) || !data) {
+        return false;
+    }
+    _load(address, length);
+    return UNIOEEPROMDetail::sameBytes(&_buffer[address], data, length);
+}
+
+/**
+ * Writes image to the device starting at address 0, and reads it back.  This
+ * is for programming parts on the line, so it waits for the device instead
+ * of going through commit().  Pages that already match are skipped.  The
+ * part ignores everything but status reads during a write cycle, so the next
+ * page is picked and staged while the last one is being written, and it is
+ * sent as soon as the part is ready.  The whole image is then checked with
+ * as few reads as setMaxReadChunk() allows.  Pages that do not check out are
+ * left dirty.
+ *
+ * Returns the number of pages written, or -1 if a write or the check failed
+ */
+template<class Device>
+int UNIOEEPROMBase<Device>::programImage(const uint8_t *image, size_t length) {
+    uint16_t page, last;
+    size_t address, chunk;
+    int written = 0;
+    bool ret = true;
+    if (!_goodAddress(0, length) || !image || (length == 0)) {
+        return -1;
+    }
+    // Changes behind a fence have to land first
+    if ((_firstEpoch() != _epoch) && !flush()) {
+        return -1;
+    }
+    last = _addressPage(length - 1);
+    for (page = 0; page <= last; page++) {
+        address = _pageAddress(page);
+        chunk = length - address;
+        if (chunk > PAGE_SIZE) {
+            chunk = PAGE_SIZE;
+        }
+        if (!_isUnloaded(page) && !_isDirty(page) && UNIOEEPROMDetail::sameBytes(&_buffer[address], &image[address], chunk)) {
+            continue;
+        }
+        if (chunk < PAGE_SIZE) {
+            // The rest of the page gets written too
+            _load(address, chunk);
+        }
+        memcpy(&_buffer[address], &image[address], chunk);
+        _clearUnloaded(page);
+        _setDirty(page);
+        // Other chips can still be writing
+        while (_writeBusy(_chipOf(page)));
+        if (!_startWrite(page)) {
+            return -1;
+        }
+        written++;
+    }
+    _writeWait();
+    // Read it all back over the cache, then put back what did not match
+    ret = _readPlan(0, last, &UNIOEEPROMBase::_isPage);
+    for (page = 0; page <= last; page++) {
+        address = _pageAddress(page);
+        chunk = length - address;
+        if (chunk > PAGE_SIZE) {
+            chunk = PAGE_SIZE;
+        }
+        if (!UNIOEEPROMDetail::sameBytes(&_buffer[address], &image[address], chunk)) {
+            memcpy(&_buffer[address], &image[address], chunk);
+            _setDirty(page);
+            ret = false;
+        }
+    }
+    if (_mirror && ret) {
+        ret = _flushMirror();
+    }
+    return ret ? written : -1;
+}
+
+template<class Device>
+bool UNIOEEPROMBase<Device>::commit(void) {
+    bool busy;
+    uint16_t epoch;
+    if (!_buffer) {
+        return false;
+    }
+    _trace(UNIO_TRACE_COMMIT, 0, 0);
+    _commits++;
+    // Catch the end of the last write, so it gets reported
+    busy = _writeBusy(_chipOf(_writePage % _pages));
+    if (_mirror) {
+        // Each chip writes while the other one is in its write cycle
+        if (_mirrorStep()) {
+            return true;
+        }
+        if (!busy && (oldestDirtyPage() < 0)) {
+            _crcStep();
+            return true;
+        }
+    }
+    if (_dirtyDeadline > 0) {
+        // Let young pages collect more writes, then go oldest first
+        int page = oldestDirtyPage();
+        if ((page < 0) || (_dirtyAge(page) < (_dirtyDeadline / 2))) {
+            return true;
+        }
+        page = _oldestDirty(true);
+        if (page < 0) {
+            return true;
+        }
+        _writePage = page;
+    }
+    if (_writePage >= _pages) {
+        _writePage = 0;
+    }
+    epoch = _firstEpoch();
+    if (_olderInFlight(epoch)) {
+        // The last epoch is not on the chips yet
+        return false;
+    }
+    if (!_canWrite(_writePage, epoch)) {
+        _writePage++;
+        return true;
+    }
+
+    if (_writeBusy(_chipOf(_writePage))) {
+        // Previous write is not finished.  Give a free chip a page instead.
+        int page = _idlePage(epoch);
+        if (page < 0) {
+            return false;
+        }
+        _writePage = page;
+    }
+    if (!_startWrite(_writePage)) {
+        // Send this page to the back of the line so the rest can drain
+        _writePage++;
+        return false;
+    }
+    _writePage++;
+    return true;
+}
+
+/**
+ * Finds a page commit() can write on a chip that is not busy.  Each chip is
+ * asked at most once, and only if it has a page to write.
+ */
+template<class Device>
+int UNIOEEPROMBase<Device>::_idlePage(uint16_t epoch) {
+    uint16_t page;
+    uint8_t chip;
+    uint8_t asked = 0, idle = 0;
+    if (_chips == 1) {
+        return -1;
+    }
+    for (page = 0; page < _pages; page++) {
+        if (!_canWrite(page, epoch)) {
+            continue;
+        }
+        chip = 1 << _chipOf(page);
+        if (!(asked & chip)) {
+            asked |= chip;
+            idle |= _writeBusy(_chipOf(page)) ? 0 : chip;
+        }
+        if (idle & chip) {
+            return page;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Starts the write of a dirty page.  Its chip must not be busy.
+ */
+template<class Device>
+bool UNIOEEPROMBase<Device>::_startWrite(uint16_t page) {
+    uint8_t chip = _chipOf(page);
+    if (!_chip[chip]->enable_write()
+        || !_chip[chip]->start_write(&_buffer[_pageAddress(page)], _chipAddress(page), _pageBytes(page))) {
+        _writeFailed(page);
+        return false;
+    }
+    _page[page].failures = 0;
+    _mirrorPage(page);
+    _busy |= 1 << chip;
+    _writing[chip] = page;
+    _writingSeq[chip] = _page[page].dirtySeq;
+    _writingEpoch[chip] = _page[page].epoch;
+    _event(UNIO_EVENT_WRITE_START, page);
+    _clearDirty(page);
+    return true;
+}
+
+template<class Device>
+void UNIOEEPROMBase<Device>::_writeThrough(void) {
+    uint16_t index;
+    uint16_t epoch = _firstEpoch();
+    _through = false;
+    for (index = 0; index < _pages; index++) {
+        if ((_page[index].mode == UNIO_WRITE_THROUGH) && _canWrite(index, epoch)) {
+            while (_olderInFlight(epoch) || _writeBusy(_chipOf(index)));
+            _startWrite(index);
+        }
+    }
+}
+
+/**
+ * Writes data inside one page straight to the device, and drops the page
+ * from the cache.  Returns false if the data has to be cached instead.
+ */
+template<class Device>
+bool UNIOEEPROMBase<Device>::_writeAround(int address, const uint8_t *data, size_t length) {
+    uint16_t page = _addressPage(address);
+    if (_mirror || _isDirty(page) || (_firstEpoch() != _epoch)) {
+        // Cached changes that have to land first, or a mirror that needs
+        // the whole page
+        return false;
+    }
+    _writeWait();
+    if (!_chip[_chipOf(page)]->enable_write()
+        || !_chip[_chipOf(page)]->start_write(data, _chipAddress(page) + (address % PAGE_SIZE), length)) {
+        _failures++;
+        return false;
+    }
+    _sequence++;
+    _busy |= 1 << _chipOf(page);
+    _writing[_chipOf(page)] = page;
+    _writingSeq[_chipOf(page)] = _sequence;
+    _writingEpoch[_chipOf(page)] = _epoch;
+    _event(UNIO_EVENT_WRITE_START, page);
+    _setUnloaded(page);
+    _setChanged(page);
+    return true;
+}
+
+template<class Device>
+bool UNIOEEPROMBase<Device>::setWriteMode(int address, size_t length, uint8_t mode) {
+    int page;
+    if (!_goodAddress(address, length) || (length == 0) || (mode > UNIO_WRITE_AROUND)) {
+        return false;
+    }
+    for (page = _addressPage(address); page <= _addressPage(address + length - 1); page++) {
+        _page[page].mode = mode;
+    }
+    return true;
+}
+
+/**
+ * Writes out the dirty pages of every epoch up to and including last, and
+ * waits for them.  One pass for each epoch, oldest first.  A failed page
+ * stays dirty and stops the later epochs.
+ */
+template<class Device>
+bool UNIOEEPROMBase<Device>::_flushEpochs(uint16_t last) {
+    uint16_t index, epoch;
+    bool ret = true;
+    _writeWait();
+    do {
+        epoch = _firstEpoch();
+        for (index = 0; index < _pages; index++) {
+            if (_inEpoch(index, epoch)) {
+                _event(UNIO_EVENT_WRITE_START, index);
+                if (_chip[_chipOf(index)]->simple_write(&_buffer[_pageAddress(index)], _chipAddress(index), _pageBytes(index))) {
+                    _page[index].failures = 0;
+                    _mirrorPage(index);
+                    _clearDirty(index);
+                    _event(UNIO_EVENT_WRITE_DONE, index);
+                } else {
+                    _writeFailed(index);
+                    ret = false;
+                }
+            }
+        }
+    } while (ret && (epoch != last));
+    return ret;
+}
+
+template<class Device>
+bool UNIOEEPROMBase<Device>::flush(void) {
+    bool ret;
+    if (!_buffer) {
+        return false;
+    }
+    _trace(UNIO_TRACE_FLUSH, 0, 0);
+    ret = _flushEpochs(_epoch);
+    if (ret && _mirror) {
+        ret = _flushMirror();
+    }
+    _event(UNIO_EVENT_FLUSH_DONE, -1);
+    return ret;
+}
+/**
+ * Applies a whole patch from a buffer.  See UNIOEEPROMPatchBase.
+ *
+ * Returns false if the patch is bad or ends early
+ */
+template<class Device>
+bool UNIOEEPROMBase<Device>::applyPatch(const uint8_t *patch, size_t length) {
+    UNIOEEPROMPatchBase<UNIOEEPROMBase> decoder(this);
+    if (!_buffer || !patch) {
+        return false;
+    }
+    return decoder.feed(patch, length) && decoder.done();
+}
+
+/**
+ * The shortest fill record the encoder makes.  Shorter runs are cheaper as
+ * data.
+ */
+#define UNIO_PATCH_MIN_FILL 4
+/**
+ * The shortest run of unchanged bytes that ends a data record.  Shorter runs
+ * cost less to send than a new record.
+ */
+#define UNIO_PATCH_MIN_GAP 3
+
+/**
+ * Starts over at address 0, for the next patch
+ */
+template<class EEPROM>
+void UNIOEEPROMPatchBase<EEPROM>::reset(void) {
+    _state = _skip;
+    _value = 0;
+    _shift = 0;
+    _address = 0;
+    _count = 0;
+}
+
+/**
+ * Adds a byte to the varint being read.  Returns true once it is complete.
+ */
+template<class EEPROM>
+bool UNIOEEPROMPatchBase<EEPROM>::_varint(uint8_t byte) {
+    if (_shift > 28) {
+        _state = _failed;
+        return false;
+    }
+    _value |= (uint32_t)(byte & 0x7F) << _shift;
+    _shift += 7;
+    return !(byte & 0x80);
+}
+
+/**
+ * Applies the next length bytes of the patch.  Anything after the end of the
+ * patch is ignored.
+ *
+ * Returns false once the patch has gone bad
+ */
+template<class EEPROM>
+bool UNIOEEPROMPatchBase<EEPROM>::feed(const uint8_t *data, size_t length) {
+    uint32_t chunk;
+    uint32_t size = _eeprom->size();
+    uint8_t byte;
+    while ((length > 0) && (_state != _done) && (_state != _failed)) {
+        if (_state == _data) {
+            chunk = (length < _count) ? length : _count;
+            _eeprom->writeBytes(_address, data, chunk);
+            _address += chunk;
+            _count -= chunk;
+            data += chunk;
+            length -= chunk;
+            if (_count == 0) {
+                _state = _skip;
+            }
+            continue;
+        }
+        byte = *data++;
+        length--;
+        if (_state == _fill) {
+            _eeprom->fillRange(_address, byte, _count);
+            _address += _count;
+            _state = _skip;
+        } else if (_varint(byte)) {
+            if (_state == _skip) {
+                _state = (_value <= (size - _address)) ? _header : _failed;
+                _address += _value;
+            } else if ((_value >> 1) == 0) {
+                _state = _done;
+            } else {
+                _count = _value >> 1;
+                if (_count > (size - _address)) {
+                    _state = _failed;
+                } else {
+                    _state = (_value & 1) ? _fill : _data;
+                }
+            }
+            _value = 0;
+            _shift = 0;
+        }
+    }
+    return _state != _failed;
+}
+
+namespace UNIOEEPROMDetail {
+
+/**
+ * Writes value as a varint at patch[used].  Returns the new used, or size + 1
+ * if it does not fit.
+ */
+static inline size_t putVarint(uint32_t value, uint8_t *patch, size_t used, size_t size)
+{
+    do {
+        if (used >= size) {
+            return size + 1;
+        }
+        patch[used++] = (value & 0x7F) | ((value > 0x7F) ? 0x80 : 0);
+        value >>= 7;
+    } while (value > 0);
+    return used;
+}
+
+/**
+ * Returns how many bytes from data[index] on are the same as it
+ */
+static inline size_t runLength(const uint8_t *data, size_t index, size_t length)
+{
+    size_t end;
+    for (end = index + 1; (end < length) && (data[end] == data[index]); end++);
+    return end - index;
+}
+
+}
+
+/**
+ * Builds the patch that turns from into to, both length bytes long, in patch.
+ * This is meant for the host side.
+ *
+ * Returns the length of the patch, or 0 if it does not fit in size bytes
+ */
+template<class EEPROM>
+size_t UNIOEEPROMPatchBase<EEPROM>::encode(const uint8_t *from, const uint8_t *to, size_t length, uint8_t *patch, size_t size) {
+    size_t index = 0, last = 0, used = 0;
+    size_t end, gap;
+    bool fill;
+    while (true) {
+        for (; (index < length) && (from[index] == to[index]); index++);
+        if (index >= length) {
+            break;
+        }
+        end = index + UNIOEEPROMDetail::runLength(to, index, length);
+        fill = (end - index) >= UNIO_PATCH_MIN_FILL;
+        if (!fill) {
+            // Take in changed bytes until a long unchanged run or a fill
+            gap = 0;
+            for (end = index + 1; (end < length) && (gap < UNIO_PATCH_MIN_GAP); end++) {
+                if (from[end] == to[end]) {
+                    gap++;
+                } else if (UNIOEEPROMDetail::runLength(to, end, length) >= UNIO_PATCH_MIN_FILL) {
+                    break;
+                } else {
+                    gap = 0;
+                }
+            }
+            end -= gap;
+        }
+        used = UNIOEEPROMDetail::putVarint(index - last, patch, used, size);
+        used = UNIOEEPROMDetail::putVarint(((end - index) << 1) | (fill ? 1 : 0), patch, used, size);
+        if (used + (fill ? 1 : end - index) > size) {
+            return 0;
+        }
+        if (fill) {
+            patch[used++] = to[index];
+        } else {
+            memcpy(&patch[used], &to[index], end - index);
+            used += end - index;
+        }
+        index = end;
+        last = end;
+    }
+    used = UNIOEEPROMDetail::putVarint(0, patch, used, size);
+    used = UNIOEEPROMDetail::putVarint(0, patch, used, size);
+    return (used > size) ? 0 : used;
+}
+
+/**
+ * Marks the pages under a range to be sent by exportDelta() again
+ */
+template<class Device>
+bool UNIOEEPROMBase<Device>::markChanged(int address, size_t length) {
+    int page;
+    if (!_goodAddress(address, length) || (length == 0)) {
+        return false;
+    }
+    for (page = _addressPage(address); page <= _addressPage(address + length - 1); page++) {
+        _setChanged(page);
+    }
+    return true;
+}
+
+template<class Device>
+uint16_t UNIOEEPROMBase<Device>::changedPages(void) {
+    uint16_t page;
+    uint16_t count = 0;
+    if (_size == 0) {
+        return 0;
+    }
+    for (page = 0; page <= _lastPage(); page++) {
+        if (_isChanged(page)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * Fills buffer with DELTA_RECORD records for the pages changed since
+ * checkpoint(), lowest page first, and marks them as sent.  Call it until it
+ * returns 0 to get them all.  Pages that change again are sent again.
+ *
+ * Returns the number of bytes used
+ */
+template<class Device>
+size_t UNIOEEPROMBase<Device>::exportDelta(uint8_t *buffer, size_t length) {
+    uint16_t page;
+    size_t address, chunk;
+    size_t used = 0;
+    if (!buffer || (_size == 0)) {
+        return 0;
+    }
+    for (page = 0; (page <= _lastPage()) && ((used + DELTA_RECORD) <= length); page++) {
+        if (!_isChanged(page)) {
+            continue;
+        }
+        address = _pageAddress(page);
+        chunk = _size - address;
+        if (chunk > PAGE_SIZE) {
+            chunk = PAGE_SIZE;
+        }
+        _load(address, chunk);
+        buffer[used] = page & 0xFF;
+        buffer[used + 1] = (page >> 8) & 0xFF;
+        memcpy(&buffer[used + 2], &_buffer[address], chunk);
+        memset(&buffer[used + 2 + chunk], 0xFF, PAGE_SIZE - chunk);
+        used += DELTA_RECORD;
+        _clearChanged(page);
+    }
+    return used;
+}
+
+/**
+ * Writes the records from exportDelta() into the cache.  Pages that already
+ * match stay clean.
+ *
+ * Returns false if a record is cut short or for a page we do not have
+ */
+template<class Device>
+bool UNIOEEPROMBase<Device>::applyDelta(const uint8_t *delta, size_t length) {
+    uint16_t page;
+    size_t address, chunk;
+    if (!delta || (_size == 0)) {
+        return false;
+    }
+    for (; length >= DELTA_RECORD; length -= DELTA_RECORD) {
+        page = delta[0] | (delta[1] << 8);
+        if (page > _lastPage()) {
+            return false;
+        }
+        address = _pageAddress(page);
+        chunk = _size - address;
+        if (chunk > PAGE_SIZE) {
+            chunk = PAGE_SIZE;
+        }
+        writeBytes(address, &delta[2], chunk);
+        delta += DELTA_RECORD;
+    }
+    return length == 0;
+}
+
+/**
+ * Adds a second chip that gets a copy of every page written to the first.
+ * Call it before begin() or beginAsync().  This only works with one chip in
+ * setChips().
+ *
+ * Both chips keep one CRC byte per page at _crcAddress().  That room is taken
+ * off the end of our space, in whole pages, so size() gets smaller.  Write
+ * around is turned off, since the mirror needs whole pages.
+ *
+ * Returns false if there is no cache to mirror or no room for the CRCs
+ */
+template<class Device>
+bool UNIOEEPROMBase<Device>::setMirror(Device *mirror) {
+    uint16_t pages;
+    if (!_buffer || (_chips > 1)) {
+        return false;
+    }
+    if (mirror && !_crc) {
+        // Whole pages only, so a CRC page write never wraps
+        pages = (_size / PAGE_SIZE) - ((_pages + PAGE_SIZE - 1) / PAGE_SIZE);
+        if ((_size < PAGE_SIZE) || (pages == 0) || (pages > _pages)) {
+            return false;
+        }
+        _size = _pageAddress(pages);
+        _pages = pages;
+        _chipPages = pages;
+        if (_blockSize > _size) {
+            _blockSize = _size;
+        }
+    }
+    _mirror = mirror;
+    if (_mirror && !_crc) {
+        _crc = new uint8_t[_lastPage() + 1];
+        memset(_crc, 0, _lastPage() + 1);
+        _mirrorPending = new uint8_t[_dirtySize];
+        memset(_mirrorPending, 0, _dirtySize);
+        _crcPrimary = new uint8_t[_dirtySize];
+        memset(_crcPrimary, 0, _dirtySize);
+        _crcMirror = new uint8_t[_dirtySize];
+        memset(_crcMirror, 0, _dirtySize);
+    }
+    return true;
+}
+
+/**
+ * Checks every page against its CRC on the primary.  A bad page is taken from
+ * the mirror if the mirror copy checks out, and written back to the primary.
+ * Otherwise the primary copy is kept, and its CRC is written to both chips.
+ */
+template<class Device>
+void UNIOEEPROMBase<Device>::_checkMirror(void) {
+    uint16_t page;
+    uint8_t data[PAGE_SIZE];
+    uint8_t crc;
+    size_t address, chunk;
+    bool table;
+    // Without the table there is nothing to judge the primary by, so keep it
+    table = _chip[0]->read(_crc, _crcAddress(), _lastPage() + 1);
+    for (page = 0; page <= _lastPage(); page++) {
+        address = _pageAddress(page);
+        chunk = _pageBytes(page);
+        if (table && (UNIOEEPROMDetail::crc8(&_buffer[address], chunk) == _crc[page])) {
+            continue;
+        }
+        if (table && _mirror->read(data, address, chunk)
+            && _mirror->read(&crc, _crcAddress() + page, 1)
+            && (UNIOEEPROMDetail::crc8(data, chunk) == crc)) {
+            memcpy(&_buffer[address], data, chunk);
+            _crc[page] = crc;
+            _setDirty(page);
+            _repairs++;
+        } else {
+            _crc[page] = UNIOEEPROMDetail::crc8(&_buffer[address], chunk);
+            UNIOEEPROMDetail::setBit(_crcPrimary, page / PAGE_SIZE);
+            UNIOEEPROMDetail::setBit(_mirrorPending, page);
+        }
+    }
+}
+
+/**
+ * Books a page that has just been sent to the primary, so it goes to the
+ * mirror next and gets a new CRC
+ */
+template<class Device>
+void UNIOEEPROMBase<Device>::_mirrorPage(uint16_t page) {
+    size_t address = _pageAddress(page);
+    if (!_mirror) {
+        return;
+    }
+    _crc[page] = UNIOEEPROMDetail::crc8(&_buffer[address], _pageBytes(page));
+    UNIOEEPROMDetail::setBit(_crcPrimary, page / PAGE_SIZE);
+    UNIOEEPROMDetail::setBit(_mirrorPending, page);
+}
+
+/**
+ * Returns true while the mirror is in a write cycle we started
+ */
+template<class Device>
+bool UNIOEEPROMBase<Device>::_mirrorBusy(void) {
+    if (_mirrorWriting && !_mirror->is_writing()) {
+        _mirrorWriting = false;
+    }
+    return _mirrorWriting;
+}
+
+/**
+ * Starts the next write the mirror is owed, if it is free.  Pages that have
+ * changed again since they went to the primary wait until they go again.
+ *
+ * Returns true if a write was started
+ */
+template<class Device>
+bool UNIOEEPROMBase<Device>::_mirrorStep(void) {
+    uint16_t page;
+    size_t address, chunk;
+    if (_mirrorBusy()) {
+        return false;
+    }
+    for (page = 0; page <= _lastPage(); page++) {
+        if (UNIOEEPROMDetail::testBit(_mirrorPending, page) && !_isDirty(page)) {
+            if (!_mirror->enable_write()
+                || !_mirror->start_write(&_buffer[_pageAddress(page)], _pageAddress(page), _pageBytes(page))) {
+                _failures++;
+                return false;
+            }
+            UNIOEEPROMDetail::clearBit(_mirrorPending, page);
+            UNIOEEPROMDetail::setBit(_crcMirror, page / PAGE_SIZE);
+            _mirrorWriting = true;
+            return true;
+        }
+    }
+    for (page = 0; page < _crcPages(); page++) {
+        if (UNIOEEPROMDetail::testBit(_crcMirror, page)) {
+            address = page * PAGE_SIZE;
+            chunk = (_lastPage() + 1) - address;
+            if (chunk > PAGE_SIZE) {
+                chunk = PAGE_SIZE;
+            }
+            if (!_mirror->enable_write()
+                || !_mirror->start_write(&_crc[address], _crcAddress() + address, chunk)) {
+                _failures++;
+                return false;
+            }
+            UNIOEEPROMDetail::clearBit(_crcMirror, page);
+            _mirrorWriting = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Starts the next CRC page write on the primary.  The primary must be free.
+ *
+ * Returns true if a write was started
+ */
+template<class Device>
+bool UNIOEEPROMBase<Device>::_crcStep(void) {
+    uint16_t page;
+    size_t address, chunk;
+    for (page = 0; page < _crcPages(); page++) {
+        if (UNIOEEPROMDetail::testBit(_crcPrimary, page)) {
+            address = page * PAGE_SIZE;
+            chunk = (_lastPage() + 1) - address;
+            if (chunk > PAGE_SIZE) {
+                chunk = PAGE_SIZE;
+            }
+            if (!_chip[0]->enable_write()
+                || !_chip[0]->start_write(&_crc[address], _crcAddress() + address, chunk)) {
+                _failures++;
+                return false;
+            }
+            UNIOEEPROMDetail::clearBit(_crcPrimary, page);
+            _busy |= 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Gets the mirror and both CRC tables up to date with the primary
+ *
+ * Returns false if a write fails
+ */
+template<class Device>
+bool UNIOEEPROMBase<Device>::_flushMirror(void) {
+    uint16_t page;
+    while (_mirrorStep()) {
+        while (_mirrorBusy());
+    }
+    _writeWait();
+    while (_crcStep()) {
+        _writeWait();
+    }
+    for (page = 0; page < _dirtySize; page++) {
+        if (_mirrorPending[page] || _crcPrimary[page] || _crcMirror[page]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Migrates layout version from with steps.  The steps are not copied, so
+ * they have to stay around.
+ *
+ * Returns false if there is no room for it or it is not a migration
+ */
+template<class EEPROM>
+bool UNIOEEPROMSchemaBase<EEPROM>::addMigration(uint16_t from, const UNIOEEPROMMigration *steps, uint16_t count) {
+    if (!steps || (count == 0) || (from == _version) || (from == 0xFFFF)
+        || (_migrations >= UNIO_EEPROM_MIGRATIONS)) {
+        return false;
+    }
+    _steps[_migrations] = steps;
+    _count[_migrations] = count;
+    _from[_migrations] = from;
+    _migrations++;
+    return true;
+}
+
+/**
+ * Reads the header.  Call it after begin() on the EEPROM.  A blank header
+ * gets a new one.  An old version with a migration starts it, and a
+ * migration that was cut off picks up where it was.
+ *
+ * Returns one of UNIO_SCHEMA_*.  An address that does not start a page is
+ * UNIO_SCHEMA_UNKNOWN, as the two copies could end up in one page.
+ */
+template<class EEPROM>
+int UNIOEEPROMSchemaBase<EEPROM>::begin(void) {
+    uint8_t header[UNIO_SCHEMA_HEADER];
+    uint8_t other[UNIO_SCHEMA_HEADER];
+    uint16_t version, from;
+    uint32_t hash;
+    uint8_t index;
+    bool first, second;
+    _active = -1;
+    _failed = false;
+    if (!_aligned()
+        || !_eeprom->readBytes(_headerAddress(0), header, sizeof(header))
+        || !_eeprom->readBytes(_headerAddress(1), other, sizeof(other))) {
+        _failed = true;
+        return UNIO_SCHEMA_UNKNOWN;
+    }
+    if (UNIOEEPROMDetail::sameValue(header, 0xFF, sizeof(header)) && UNIOEEPROMDetail::sameValue(other, 0xFF, sizeof(other))) {
+        // A new part
+        _found = _version;
+        _step = 0;
+        _done = 0;
+        _serial = 0xFF;
+        return _writeHeader(0xFFFF) ? UNIO_SCHEMA_NEW : UNIO_SCHEMA_UNKNOWN;
+    }
+    // Take the newer good copy
+    first = _readHeader(0, header);
+    second = _readHeader(1, other);
+    if (second && (!first || ((int8_t)(other[14] - header[14]) > 0))) {
+        memcpy(header, other, sizeof(header));
+    } else if (!first) {
+        return UNIO_SCHEMA_UNKNOWN;
+    }
+    _serial = header[14];
+    version = header[2] | (header[3] << 8);
+    hash = header[4] | (header[5] << 8) | ((uint32_t)header[6] << 16) | ((uint32_t)header[7] << 24);
+    from = header[8] | (header[9] << 8);
+    _found = version;
+    if (from != 0xFFFF) {
+        // A migration was cut off.  It has to be to this layout.
+        if ((version != _version) || (hash != _hash)) {
+            return UNIO_SCHEMA_UNKNOWN;
+        }
+        _found = from;
+        _step = header[10] | (header[11] << 8);
+        _done = header[12] | (header[13] << 8);
+    } else if ((version == _version) && (hash == _hash)) {
+        return UNIO_SCHEMA_OK;
+    } else {
+        from = version;
+        _step = 0;
+        _done = 0;
+    }
+    for (index = 0; index < _migrations; index++) {
+        if (_from[index] == from) {
+            _active = index;
+        }
+    }
+    if ((_active < 0) || (_step >= _count[_active]) || !_writeHeader(from)) {
+        _active = -1;
+        return UNIO_SCHEMA_UNKNOWN;
+    }
+    // The header goes before anything the migration moves
+    _eeprom->fence();
+    return UNIO_SCHEMA_MIGRATING;
+}
+
+/**
+ * Stops any migration and writes a header for this layout, for after the
+ * caller has set up the fields itself.
+ *
+ * Returns false if the header could not be written
+ */
+template<class EEPROM>
+bool UNIOEEPROMSchemaBase<EEPROM>::reset(void) {
+    _active = -1;
+    _failed = false;
+    _found = _version;
+    _step = 0;
+    _done = 0;
+    return _aligned() && _writeHeader(0xFFFF);
+}
+
+/**
+ * Checks one copy of the header, already read into header
+ */
+template<class EEPROM>
+bool UNIOEEPROMSchemaBase<EEPROM>::_readHeader(uint8_t copy, uint8_t *header) {
+    return (UNIOEEPROMDetail::crc8(header, UNIO_SCHEMA_HEADER - 1) == header[UNIO_SCHEMA_HEADER - 1])
+        && ((header[0] | (header[1] << 8)) == UNIO_SCHEMA_MAGIC) && ((header[14] & 1) == copy);
+}
+
+/**
+ * Writes the next copy of the header
+ */
+template<class EEPROM>
+bool UNIOEEPROMSchemaBase<EEPROM>::_writeHeader(uint16_t from) {
+    uint8_t header[UNIO_SCHEMA_HEADER];
+    header[0] = UNIO_SCHEMA_MAGIC & 0xFF;
+    header[1] = (UNIO_SCHEMA_MAGIC >> 8) & 0xFF;
+    header[2] = _version & 0xFF;
+    header[3] = (_version >> 8) & 0xFF;
+    header[4] = _hash & 0xFF;
+    header[5] = (_hash >> 8) & 0xFF;
+    header[6] = (_hash >> 16) & 0xFF;
+    header[7] = (_hash >> 24) & 0xFF;
+    header[8] = from & 0xFF;
+    header[9] = (from >> 8) & 0xFF;
+    header[10] = _step & 0xFF;
+    header[11] = (_step >> 8) & 0xFF;
+    header[12] = _done & 0xFF;
+    header[13] = (_done >> 8) & 0xFF;
+    header[14] = ++_serial;
+    header[15] = UNIOEEPROMDetail::crc8(header, sizeof(header) - 1);
+    return _eeprom->writeBytes(_headerAddress(_serial), header, sizeof(header));
+}
+
+/**
+ * The bytes the next piece of step does.  A piece stays inside one page of
+ * dest.  A copy up in memory goes from the end, and no piece of a copy is
+ * bigger than the distance it moves, so doing a piece over reads the same
+ * bytes.
+ */
+template<class EEPROM>
+uint16_t UNIOEEPROMSchemaBase<EEPROM>::_piece(const UNIOEEPROMMigration &step) {
+    uint16_t left = step.length - _done;
+    uint16_t chunk, gap;
+    if (step.op == UNIO_MIGRATE_TRANSFORM) {
+        return step.length;
+    }
+    if ((step.op == UNIO_MIGRATE_COPY) && (step.dest > step.src)) {
+        chunk = (step.dest + left) % EEPROM::PAGE_SIZE;
+        if (chunk == 0) {
+            chunk = EEPROM::PAGE_SIZE;
+        }
+    } else {
+        chunk = EEPROM::PAGE_SIZE - ((step.dest + _done) % EEPROM::PAGE_SIZE);
+    }
+    if (chunk > left) {
+        chunk = left;
+    }
+    if (step.op == UNIO_MIGRATE_COPY) {
+        gap = (step.dest > step.src) ? (step.dest - step.src) : (step.src - step.dest);
+        if ((gap > 0) && (chunk > gap)) {
+            chunk = gap;
+        }
+    }
+    return chunk;
+}
+
+/**
+ * Does the next piece of the migration, then saves how far it has got.
+ * Nothing is done while the EEPROM has pages to write, so call commit() in
+ * between.
+ *
+ * Returns false once there is nothing more to do, or it failed
+ */
+template<class EEPROM>
+bool UNIOEEPROMSchemaBase<EEPROM>::step(void) {
+    uint8_t from[EEPROM::PAGE_SIZE];
+    uint8_t buffer[EEPROM::PAGE_SIZE];
+    uint16_t chunk, offset;
+    bool ret = true;
+    if (_active < 0) {
+        return false;
+    }
+    if (_eeprom->oldestDirtyPage() >= 0) {
+        // The last piece is still going out
+        return true;
+    }
+    const UNIOEEPROMMigration &step = _steps[_active][_step];
+    chunk = _piece(step);
+    offset = _done;
+    if ((step.op == UNIO_MIGRATE_COPY) && (step.dest > step.src)) {
+        offset = step.length - _done - chunk;
+    }
+    if (chunk == 0) {
+        // Nothing to move
+    } else if (step.op == UNIO_MIGRATE_COPY) {
+        ret = _eeprom->readBytes(step.src + offset, buffer, chunk)
+            && _eeprom->writeBytes(step.dest + offset, buffer, chunk);
+    } else if (step.op == UNIO_MIGRATE_FILL) {
+        ret = _eeprom->fillRange(step.dest + offset, step.src, chunk) >= 0;
+    } else if ((step.op == UNIO_MIGRATE_TRANSFORM) && step.transform
+               && (((step.dest % EEPROM::PAGE_SIZE) + chunk) <= EEPROM::PAGE_SIZE)
+               && _eeprom->readBytes(step.src, from, chunk)) {
+        step.transform(from, buffer, chunk);
+        ret = _eeprom->writeBytes(step.dest, buffer, chunk);
+    } else {
+        ret = false;
+    }
+    if (!ret) {
+        _failed = true;
+        _active = -1;
+        return false;
+    }
+    _done += chunk;
+    if (_done >= step.length) {
+        _step++;
+        _done = 0;
+    }
+    // The piece is on the chip before the header says so, and the header is
+    // on the chip before the next piece
+    _eeprom->fence();
+    if (_step >= _count[_active]) {
+        _active = -1;
+        _step = 0;
+        _found = _version;
+        _writeHeader(0xFFFF);
+    } else {
+        _writeHeader(_from[_active]);
+    }
+    _eeprom->fence();
+    return _active >= 0;
+}
+
+/**
+ * Does the rest of the migration now, flushing each piece
+ *
+ * Returns false if it failed
+ */
+template<class EEPROM>
+bool UNIOEEPROMSchemaBase<EEPROM>::finish(void) {
+    while (step()) {
+        if (!_eeprom->flush()) {
+            return false;
+        }
+    }
+    return _eeprom->flush() && !_failed;
+}
+
+/**
+ * Spreads our space over count chips, which all have to hold their share.
+ * With UNIO_CHIPS_CONCAT each chip has a run of pages, one after the other.
+ * With UNIO_CHIPS_STRIPE pages go to the chips in turn, so a run of pages
+ * keeps every chip busy.  commit() keeps a write going on every chip that has
+ * a page to write.  Call it before begin().
+ *
+ * Returns false if count is not 1 to UNIO_EEPROM_CHIPS, or with a mirror
+ */
+template<class Device>
+bool UNIOEEPROMBase<Device>::setChips(Device **chips, uint8_t count, uint8_t layout) {
+    uint8_t chip;
+    if (!chips || (count == 0) || (count > UNIO_EEPROM_CHIPS) || (layout > UNIO_CHIPS_STRIPE)
+        || (_mirror && (count > 1))) {
+        return false;
+    }
+    _writeWait();
+    for (chip = 0; chip < count; chip++) {
+        _chip[chip] = chips[chip];
+        _writing[chip] = -1;
+    }
+    _chips = count;
+    _striped = (layout == UNIO_CHIPS_STRIPE);
+    _chipPages = ((_lastPage() + 1) + count - 1) / count;
+    return true;
+}
+
+#endif // UNIO_EEPROM_Impl_h
@@ -5,4 +5,17 @@
 #define noInterrupts()
 #define interrupts()
 
+/**
+ * The tests set the time through this.  Each thread has its own.
+ */
+inline unsigned long &mockMillis(void)
+{
+    static thread_local unsigned long ms = 0;
+    return ms;
+}
+inline unsigned long millis(void)
+{
+    return mockMillis();
+}
+
 #endif // ARDUINO_H
\ No newline at end of file
@@ -31,19 +31,79 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.  */
 #include <cstdint>
 #include <cstdio>
 
+/**
+ * Bus timing for the bustime counter, in us.  This is 100 kbps, where each
+ * byte is 8 bits plus MAK and SAK, and every command starts with a standby
+ * pulse.
+ */
+#define UNIO_MOCK_BIT_US 10
+#define UNIO_MOCK_BYTE_US (10 * UNIO_MOCK_BIT_US)
+#define UNIO_MOCK_STANDBY_US 600
+/** The write cycle time, in us.  This is T_WC for the 11AA parts. */
+#define UNIO_MOCK_WRITE_US 5000
+/** The page size of the 11AA parts */
+#define UNIO_MOCK_PAGE_SIZE 16
+
 class UNIO {
     private:
     uint8_t *_buffer = NULL;
+    uint32_t *_wear = NULL;
     uint8_t _addr = 0;
     bool _wenable = false;
     uint8_t _protect = 0;
-    int16_t _wtimer = 0;
+    uint32_t _wdone = 0;
     uint32_t _size = 0;
+
+    /* Counts the bus time for one command of bytes, including the header
+        and device address. */
+    void _bus(uint32_t bytes)
+    {
+        uint32_t time = UNIO_MOCK_STANDBY_US + ((bytes + 2) * UNIO_MOCK_BYTE_US);
+        bustime += time;
+        clock() += time;
+    }
     
     public:
     uint32_t writecounter = 0;
+    uint32_t readcounter = 0;
+    uint32_t bustime = 0;
     bool enable_write_ret = true;
     bool start_write_ret = true;
+    int32_t fail_address = -1;
+
+    /* The time on the bus, in us, shared by every device.  Write cycles run
+        on this clock, so one device finishes writing while another one is
+        being talked to.  Each thread has its own bus. */
+    static uint32_t &clock(void)
+    {
+        static thread_local uint32_t time = 0;
+        return time;
+    }
+
+    /* Power for every device on this thread's bus */
+    static bool &powered(void)
+    {
+        static thread_local bool power = true;
+        return power;
+    }
+    static int32_t &cut_bytes(void)
+    {
+        static thread_local int32_t bytes = -1;
+        return bytes;
+    }
+    /* Cuts the power after start_write() has programmed this many more data
+        bytes, on any device.  The write it happens in is left torn: the
+        bytes before the cut are new and the rest are old.  -1 turns it
+        off. */
+    static void cut_power_after(int32_t bytes)
+    {
+        cut_bytes() = bytes;
+    }
+    static void power_on(void)
+    {
+        powered() = true;
+        cut_bytes() = -1;
+    }
 
     /**
      * @brief Constructor for UNIO library
@@ -53,10 +113,11 @@ class UNIO {
      * For Arduino UNO or Nano the pin must be a Port D Pin number
      * For Arduino SAMC the pin must be a Port A pin number
      */
-    UNIO(uint8_t address = 0, uint32_t size = 128)
-    :_addr(address),_size(size)
+    UNIO(uint8_t address = 0, uint32_t size = EEPROM_SIZE)
+    :_addr(address),_wdone(clock()),_size(size)
     {
         _buffer = new uint8_t[size];
+        _wear = new uint32_t[(size + UNIO_MOCK_PAGE_SIZE - 1) / UNIO_MOCK_PAGE_SIZE]();
         // Clear the memory
         clear();
     }
@@ -64,6 +125,7 @@ class UNIO {
     ~UNIO()
     {
         delete [] _buffer;
+        delete [] _wear;
     }
 
 
@@ -75,7 +137,9 @@ class UNIO {
         still have been overwritten. */
     bool read(uint8_t *buffer, uint16_t address, uint16_t length)
     {
-        if ((address + length) <= EEPROM_SIZE) {
+        readcounter++;
+        _bus(3 + length);
+        if (powered() && ((address + length) <= _size)) {
             memcpy(buffer, &_buffer[address], length);
             return true;
         }
@@ -96,13 +160,27 @@ class UNIO {
         finished. */
     bool start_write(const uint8_t *buffer, uint16_t address, uint16_t length)
     {
-        if (start_write_ret == false) {
+        _bus(3 + length);
+        if ((start_write_ret == false) || !powered()) {
             return false;
         }
-        if ((address + length) <= EEPROM_SIZE) {
+        if ((fail_address >= address) && (fail_address < (address + length))) {
+            return false;
+        }
+        if ((address + length) <= _size) {
+            if ((cut_bytes() >= 0) && (cut_bytes() < length)) {
+                memcpy(&_buffer[address], buffer, cut_bytes());
+                powered() = false;
+                _wenable = false;
+                return false;
+            }
+            if (cut_bytes() >= 0) {
+                cut_bytes() -= length;
+            }
             memcpy(&_buffer[address], buffer, length);
-            _wtimer = length + 1;
-            disable_write();
+            _wdone = clock() + UNIO_MOCK_WRITE_US;
+            _wenable = false;
+            _wear[address / UNIO_MOCK_PAGE_SIZE]++;
             writecounter++;
             return true;
         }
@@ -113,13 +191,15 @@ class UNIO {
         the bit is cleared on a successful write. */
     bool enable_write(void)
     {
-        _wenable = enable_write_ret;
-        return enable_write_ret;
+        _bus(1);
+        _wenable = enable_write_ret && powered();
+        return _wenable;
     }
     
     /* Clear the write enable bit. */
     bool disable_write(void)
     {
+        _bus(1);
         _wenable = false;
         return true;
     }
@@ -131,9 +211,12 @@ class UNIO {
         0x08 - block protect 1 */
     bool read_status(uint8_t *status) 
     {
+        _bus(2);
         *status = 0;
-        if (_wtimer > 0) {
-            _wtimer--;
+        if (!powered()) {
+            return false;
+        }
+        if ((int32_t)(_wdone - clock()) > 0) {
             *status |= 0x01;
         }
         if (_wenable) {
@@ -162,6 +245,7 @@ class UNIO {
         before continuing (call await_write_complete()).  */
     bool write_status(uint8_t status)
     {
+        _bus(2);
         switch (status) {
             case 0x00:
                 _protect = 0;
@@ -220,7 +304,7 @@ class UNIO {
     }
     bool set(uint16_t addr, uint8_t value)
     {
-        if (addr < EEPROM_SIZE) {
+        if (addr < _size) {
             _buffer[addr] = value;
             return true;
         }
@@ -228,21 +312,29 @@ class UNIO {
     }
     uint8_t get(uint16_t addr)
     {
-        if (addr < EEPROM_SIZE) {
+        if (addr < _size) {
             return _buffer[addr];
         }
         return 0;
     }
+    /* The number of write cycles page has been through */
+    uint32_t wear(uint16_t page)
+    {
+        if (page < ((_size + UNIO_MOCK_PAGE_SIZE - 1) / UNIO_MOCK_PAGE_SIZE)) {
+            return _wear[page];
+        }
+        return 0;
+    }
     void incrementPattern(void)
     {
         uint32_t index;
-        for (index = 0; index < EEPROM_SIZE; index++) {
+        for (index = 0; index < _size; index++) {
             set(index, index & 0xFF);
         }
     }
     void clear(void)
     {
-        memset(_buffer, 0xff, EEPROM_SIZE);
+        memset(_buffer, 0xff, _size);
     }
     /**
      * Copying not allowed
@@ -0,0 +1,355 @@
+/**
+ * @file       test/bench_unio_eeprom.cpp
+ * @author     Scott L. Price <prices@hugllc.com>
+ * @copyright  © 2016 Hunt Utilities Group, LLC
+ * @brief   Host benchmarks for UNIO_EEPROM.cpp
+ * @details
+ *
+ * This runs against the UNIO mock, so the times are for the cache code only.
+ *
+ */
+/*
+ *
+ */
+#include <stdio.h>
+#include <inttypes.h>
+#include <chrono>
+#include "Arduino.h"
+#include "UNIO.h"
+#include "UNIO_EEPROM.h"
+
+#define BENCH_LOOPS 20000
+#define BENCH_LENGTH 64
+
+static uint8_t pattern[EEPROM_SIZE];
+
+/**
+ * Runs fct BENCH_LOOPS times and prints the ns per call
+ */
+template<typename F>
+static void bench(const char *name, F fct)
+{
+    uint32_t index;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (index = 0; index < BENCH_LOOPS; index++) {
+        fct(index);
+    }
+    std::chrono::nanoseconds ns = std::chrono::steady_clock::now() - start;
+    printf("%-44s %10.1f ns\n", name, (double) ns.count() / BENCH_LOOPS);
+}
+
+static void benchBytes(void)
+{
+    UNIO unio(0, EEPROM_SIZE);
+    UNIOEEPROMClass EEPROM(&unio, EEPROM_SIZE);
+    uint8_t buffer[BENCH_LENGTH];
+    int address = 8;
+    volatile bool same = false;
+    EEPROM.begin();
+
+    printf("\n%d byte ranges\n", BENCH_LENGTH);
+    bench("write() loop, changed data", [&](uint32_t loop) {
+        int index;
+        for (index = 0; index < BENCH_LENGTH; index++) {
+            EEPROM.write(address + index, pattern[(loop + index) & 0xFF]);
+        }
+    });
+    bench("writeBytes(), changed data", [&](uint32_t loop) {
+        EEPROM.writeBytes(address, &pattern[loop & 0xFF], BENCH_LENGTH);
+    });
+    bench("write() loop, same data", [&](uint32_t loop) {
+        int index;
+        for (index = 0; index < BENCH_LENGTH; index++) {
+            EEPROM.write(address + index, pattern[index]);
+        }
+    });
+    bench("writeBytes(), same data", [&](uint32_t loop) {
+        EEPROM.writeBytes(address, pattern, BENCH_LENGTH);
+    });
+    bench("read() loop", [&](uint32_t loop) {
+        int index;
+        for (index = 0; index < BENCH_LENGTH; index++) {
+            buffer[index] = EEPROM.read(address + index);
+        }
+    });
+    bench("readBytes()", [&](uint32_t loop) {
+        EEPROM.readBytes(address, buffer, BENCH_LENGTH);
+    });
+    bench("read() loop compare", [&](uint32_t loop) {
+        int index;
+        bool match = true;
+        for (index = 0; index < BENCH_LENGTH; index++) {
+            match = match && (EEPROM.read(address + index) == pattern[index]);
+        }
+        same = match;
+    });
+    bench("equals()", [&](uint32_t loop) {
+        same = EEPROM.equals(address, pattern, BENCH_LENGTH);
+    });
+    bench("write() loop fill", [&](uint32_t loop) {
+        int index;
+        for (index = 0; index < BENCH_LENGTH; index++) {
+            EEPROM.write(address + index, loop & 0xFF);
+        }
+    });
+    bench("fill()", [&](uint32_t loop) {
+        EEPROM.fill(address, loop & 0xFF, BENCH_LENGTH);
+    });
+    (void) same;
+}
+
+static void benchClear(void)
+{
+    UNIO unio(0, EEPROM_SIZE);
+    UNIOEEPROMClass EEPROM(&unio, EEPROM_SIZE);
+    uint32_t writes;
+    EEPROM.begin();
+
+    printf("\nClearing a fresh device to 0xFF\n");
+    bench("write() loop", [&](uint32_t loop) {
+        int index;
+        for (index = 0; index < EEPROM_SIZE; index++) {
+            EEPROM.write(index, 0xFF);
+        }
+    });
+    bench("clear()", [&](uint32_t loop) {
+        EEPROM.clear();
+    });
+    writes = unio.writecounter;
+    EEPROM.clear(0);
+    EEPROM.flush();
+    printf("%-44s %10" PRIu32 " pages\n", "page writes for clear(0)", unio.writecounter - writes);
+    writes = unio.writecounter;
+    EEPROM.clear(0);
+    EEPROM.flush();
+    printf("%-44s %10" PRIu32 " pages\n", "page writes for clear(0) again", unio.writecounter - writes);
+}
+
+static void benchReadPlan(void)
+{
+    UNIO unio(0, EEPROM_SIZE);
+    UNIOEEPROMClass EEPROM(&unio, EEPROM_SIZE);
+    uint32_t start;
+    int page;
+    EEPROM.begin();
+
+    printf("\nBus time to revert %d dirty pages\n", EEPROM.pages() / 2);
+    EEPROM.fill(0, 0, EEPROM_SIZE / 2);
+    start = unio.bustime;
+    for (page = 0; page < EEPROM.pages() / 2; page++) {
+        EEPROM.discardRange(page * UNIO_PAGE_SIZE, UNIO_PAGE_SIZE);
+    }
+    printf("%-44s %10" PRIu32 " us\n", "a page at a time", unio.bustime - start);
+    EEPROM.fill(0, 0, EEPROM_SIZE / 2);
+    start = unio.bustime;
+    EEPROM.discard();
+    printf("%-44s %10" PRIu32 " us\n", "discard()", unio.bustime - start);
+    EEPROM.setMaxReadChunk(128);
+    EEPROM.fill(0, 0, EEPROM_SIZE / 2);
+    start = unio.bustime;
+    EEPROM.discard();
+    printf("%-44s %10" PRIu32 " us\n", "discard(), 128 byte chunks", unio.bustime - start);
+}
+
+/**
+ * Writes records of length bytes in mode, then waits for them to be on the
+ * chip
+ */
+static void benchMode(const char *name, uint8_t mode, uint16_t length)
+{
+    UNIO unio(0, EEPROM_SIZE);
+    UNIOEEPROMClass EEPROM(&unio, EEPROM_SIZE);
+    uint32_t start, bus, index;
+    int address = 0;
+    std::chrono::nanoseconds ns(0);
+    EEPROM.begin();
+    EEPROM.setWriteMode(mode);
+    start = unio.bustime;
+    for (index = 0; index < 64; index++) {
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        EEPROM.writeBytes(address, &pattern[index], length);
+        ns += std::chrono::steady_clock::now() - begin;
+        address = (address + length) % (EEPROM_SIZE - length);
+    }
+    EEPROM.waitDurable(EEPROM.sequence());
+    bus = unio.bustime - start;
+    printf("%-20s %10.1f ns %10" PRIu32 " us %6" PRIu32 " writes\n", name,
+           (double) ns.count() / 64, bus / 64, unio.writecounter);
+}
+
+static void benchModes(void)
+{
+    printf("\nWrite modes, 64 records (call latency, bus time per record, page writes)\n");
+    printf("16 byte records\n");
+    benchMode("write back", UNIO_WRITE_BACK, 16);
+    benchMode("write through", UNIO_WRITE_THROUGH, 16);
+    benchMode("write around", UNIO_WRITE_AROUND, 16);
+    printf("5 byte records\n");
+    benchMode("write back", UNIO_WRITE_BACK, 5);
+    benchMode("write through", UNIO_WRITE_THROUGH, 5);
+    benchMode("write around", UNIO_WRITE_AROUND, 5);
+}
+
+/**
+ * Prints the bus time for one way of programming a whole image
+ */
+static void benchProgramLine(const char *name, UNIO &unio, uint32_t start, uint32_t writes)
+{
+    uint32_t bus = unio.bustime - start;
+    printf("%-32s %10" PRIu32 " us %8.0f B/s %6" PRIu32 " writes\n", name, bus,
+           (double) EEPROM_SIZE * 1000000.0 / bus, unio.writecounter - writes);
+}
+
+static void benchProgram(void)
+{
+    UNIO unio(0, EEPROM_SIZE);
+    UNIOEEPROMClass EEPROM(&unio, EEPROM_SIZE);
+    uint8_t image[EEPROM_SIZE], check[EEPROM_SIZE];
+    uint32_t start, writes, index;
+    EEPROM.begin();
+
+    printf("\nProgramming a %d byte image (bus time, throughput, page writes)\n", EEPROM_SIZE);
+    for (index = 0; index < sizeof(image); index++) {
+        image[index] = (index * 7) & 0xFF;
+    }
+    start = unio.bustime;
+    writes = unio.writecounter;
+    EEPROM.writeBytes(0, image, sizeof(image));
+    EEPROM.flush();
+    for (index = 0; index < sizeof(check); index += UNIO_PAGE_SIZE) {
+        unio.read(&check[index], index, UNIO_PAGE_SIZE);
+    }
+    benchProgramLine("writeBytes(), flush(), page reads", unio, start, writes);
+    unio.clear();
+    EEPROM.begin();
+    start = unio.bustime;
+    writes = unio.writecounter;
+    EEPROM.programImage(image, sizeof(image));
+    benchProgramLine("programImage()", unio, start, writes);
+    for (index = 0; index < sizeof(image); index += 8 * UNIO_PAGE_SIZE) {
+        image[index] ^= 0xFF;
+    }
+    start = unio.bustime;
+    writes = unio.writecounter;
+    EEPROM.programImage(image, sizeof(image));
+    benchProgramLine("programImage(), 1 page in 8 new", unio, start, writes);
+    printf("%-32s %10d us\n", "write cycles alone", EEPROM.pages() * UNIO_MOCK_WRITE_US);
+    (void) check;
+}
+
+static void benchDelta(void)
+{
+    UNIO unio(0, EEPROM_SIZE);
+    UNIOEEPROMClass EEPROM(&unio, EEPROM_SIZE);
+    uint8_t buffer[8 * UNIO_DELTA_RECORD];
+    size_t length, total;
+    uint32_t index;
+    EEPROM.begin();
+
+    printf("\nReplicating changes (bytes sent)\n");
+    for (index = 0; index < 10; index++) {
+        EEPROM.put(index * 100, index);
+    }
+    total = 0;
+    while ((length = EEPROM.exportDelta(buffer, sizeof(buffer))) > 0) {
+        total += length;
+    }
+    printf("%-44s %10u bytes\n", "exportDelta(), 10 four byte records", (unsigned) total);
+    printf("%-44s %10u bytes\n", "whole device", (unsigned) EEPROM.size());
+}
+
+/**
+ * Dirties every page and drains them with commit(), with or without a mirror
+ */
+static void benchMirrorDrain(const char *name, bool mirrored)
+{
+    UNIO unio(0, 2 * EEPROM_SIZE);
+    UNIO mirror(0, 2 * EEPROM_SIZE);
+    UNIOEEPROMClass EEPROM(&unio, EEPROM_SIZE);
+    uint32_t start, writes, calls = 0;
+    if (mirrored) {
+        EEPROM.setMirror(&mirror);
+    }
+    EEPROM.begin();
+    EEPROM.flush();
+    // setMirror() takes the CRCs off the end, so use size()
+    EEPROM.fill(0, 0, EEPROM.size());
+    start = UNIO::clock();
+    writes = unio.writecounter + mirror.writecounter;
+    while (!EEPROM.isDurable(EEPROM.sequence())) {
+        EEPROM.commit();
+        calls++;
+    }
+    // Whatever the mirror is still owed
+    EEPROM.flush();
+    printf("%-32s %10" PRIu32 " us %8" PRIu32 " calls %6" PRIu32 " writes\n", name,
+           UNIO::clock() - start, calls, unio.writecounter + mirror.writecounter - writes);
+}
+
+static void benchMirror(void)
+{
+    printf("\nCommitting every page (time, commit() calls, page writes on both chips)\n");
+    benchMirrorDrain("one chip", false);
+    benchMirrorDrain("primary and mirror", true);
+}
+
+/**
+ * Dirties count chips worth of pages and drains them with commit()
+ */
+static void benchChipsDrain(uint8_t count, uint8_t layout)
+{
+    UNIO *unio[UNIO_EEPROM_CHIPS];
+    UNIOEEPROMClass *EEPROM;
+    uint32_t start, time, writes = 0;
+    uint8_t index;
+    char name[40];
+    for (index = 0; index < count; index++) {
+        unio[index] = new UNIO(0, EEPROM_SIZE);
+    }
+    EEPROM = new UNIOEEPROMClass(unio[0], count * EEPROM_SIZE);
+    EEPROM->setChips(unio, count, layout);
+    EEPROM->begin();
+    EEPROM->fill(0, 0, count * EEPROM_SIZE);
+    start = UNIO::clock();
+    EEPROM->waitDurable(EEPROM->sequence());
+    EEPROM->flush();
+    time = UNIO::clock() - start;
+    for (index = 0; index < count; index++) {
+        writes += unio[index]->writecounter;
+    }
+    snprintf(name, sizeof(name), "%u %s", count, (layout == UNIO_CHIPS_STRIPE) ? "striped" : "concatenated");
+    printf("%-32s %10" PRIu32 " us %8.0f B/s %6" PRIu32 " writes\n", name, time,
+           (double) count * EEPROM_SIZE * 1000000.0 / time, writes);
+    delete EEPROM;
+    for (index = 0; index < count; index++) {
+        delete unio[index];
+    }
+}
+
+static void benchChips(void)
+{
+    printf("\nWriting every page of %d byte chips with commit() (time, throughput, page writes)\n", EEPROM_SIZE);
+    benchChipsDrain(1, UNIO_CHIPS_CONCAT);
+    benchChipsDrain(2, UNIO_CHIPS_CONCAT);
+    benchChipsDrain(4, UNIO_CHIPS_CONCAT);
+    benchChipsDrain(2, UNIO_CHIPS_STRIPE);
+    benchChipsDrain(4, UNIO_CHIPS_STRIPE);
+}
+
+int main(void)
+{
+    uint32_t index;
+    for (index = 0; index < sizeof(pattern); index++) {
+        pattern[index] = index & 0xFF;
+    }
+    printf("UNIO_EEPROM benchmark (%d byte device)\n", EEPROM_SIZE);
+    benchBytes();
+    benchClear();
+    benchReadPlan();
+    benchModes();
+    benchProgram();
+    benchDelta();
+    benchMirror();
+    benchChips();
+    return 0;
+}
@@ -0,0 +1,260 @@
+/**
+ * @file       test/powerfail_unio_eeprom.cpp
+ * @author     Scott L. Price <prices@hugllc.com>
+ * @copyright  © 2016 Hunt Utilities Group, LLC
+ * @brief   Power fail runs for UNIO_EEPROM.cpp
+ * @details
+ *
+ * Usage: run_powerfail [cycles]
+ *
+ * Each cycle boots, keeps updating a record that straddles two pages, cuts
+ * the power at a random byte of a page write, then reboots and reads the
+ * record back.  The cycles for each mode are spread over every core.  It
+ * reports, for each mode:
+ *
+ *  - torn: the record read back was never written
+ *  - acked lost: an update isDurable() said was on the chip came back older
+ *  - lost: updates made but not read back, and how long they covered
+ *  - begin(): the bus time begin() took to get going again
+ *  - order: the fence() modes also keep a copy of the record inside one page,
+ *    and write the update number to another page after a fence(), every
+ *    other update.  This counts the reboots where the number is ahead of a
+ *    copy that is not torn.
+ *
+ */
+/*
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <thread>
+#include <vector>
+#include <random>
+#include "Arduino.h"
+#include "UNIO.h"
+#include "UNIO_EEPROM.h"
+
+#define POWERFAIL_CYCLES 4000
+#define POWERFAIL_UPDATES 256
+#define POWERFAIL_CUT_RANGE 400
+#define POWERFAIL_ADDRESS (UNIO_PAGE_SIZE - 4)
+#define POWERFAIL_COPY (2 * UNIO_PAGE_SIZE)
+#define POWERFAIL_HEADER (4 * UNIO_PAGE_SIZE)
+/** Time between updates in the deadline mode, in us, so the pages age */
+#define POWERFAIL_IDLE_US 1000
+
+/**
+ * The record.  inv is always ~value, so a torn record shows up.
+ */
+struct Record {
+    uint32_t value;
+    uint32_t inv;
+};
+
+/**
+ * How a mode sets up the cache and pushes each update out
+ */
+struct Mode {
+    const char *name;
+    uint8_t writeMode;
+    bool mirror;
+    bool flushEach;
+    uint32_t deadline;
+    bool fence;
+};
+
+static const Mode modes[] = {
+    { "write back, commit()", UNIO_WRITE_BACK, false, false, 0, false },
+    { "write back, flush()", UNIO_WRITE_BACK, false, true, 0, false },
+    { "write through", UNIO_WRITE_THROUGH, false, false, 0, false },
+    { "write around", UNIO_WRITE_AROUND, false, false, 0, false },
+    { "mirror, commit()", UNIO_WRITE_BACK, true, false, 0, false },
+    { "mirror, flush()", UNIO_WRITE_BACK, true, true, 0, false },
+    { "deadline 20 ms", UNIO_WRITE_BACK, false, false, 20, false },
+    { "fence(), commit()", UNIO_WRITE_BACK, false, false, 0, true },
+    { "fence(), flush()", UNIO_WRITE_BACK, false, true, 0, true },
+};
+
+struct Stats {
+    uint32_t cycles;
+    uint32_t torn;
+    uint32_t ackedLost;
+    uint32_t order;
+    uint32_t lost;
+    uint32_t lostMax;
+    uint64_t window;
+    uint32_t windowMax;
+    uint64_t recovery;
+    uint32_t recoveryMax;
+};
+
+static UNIOEEPROMClass *boot(const Mode &mode, UNIO *unio, UNIO *mirror)
+{
+    UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+    if (mode.mirror) {
+        EEPROM->setMirror(mirror);
+    }
+    EEPROM->begin();
+    EEPROM->setWriteMode(mode.writeMode);
+    EEPROM->setDirtyDeadline(mode.deadline);
+    return EEPROM;
+}
+
+/**
+ * One cut and reboot
+ */
+static void cycle(const Mode &mode, std::mt19937 &rng, Stats &stats)
+{
+    UNIO unio(0, 2 * EEPROM_SIZE);
+    UNIO mirror(0, 2 * EEPROM_SIZE);
+    UNIOEEPROMClass *EEPROM;
+    Record record = { 0, ~0u };
+    Record copy = { 0, ~0u };
+    uint32_t written[POWERFAIL_UPDATES + 1];
+    uint32_t value, acked = 0, start, cut, index, header = 0;
+
+    UNIO::power_on();
+    EEPROM = boot(mode, &unio, &mirror);
+    EEPROM->put(POWERFAIL_ADDRESS, record);
+    EEPROM->put(POWERFAIL_COPY, record);
+    EEPROM->put(POWERFAIL_HEADER, header);
+    EEPROM->flush();
+    UNIO::cut_power_after(rng() % POWERFAIL_CUT_RANGE);
+    for (value = 1; value <= POWERFAIL_UPDATES; value++) {
+        record.value = value;
+        record.inv = ~value;
+        if (mode.deadline > 0) {
+            UNIO::clock() += POWERFAIL_IDLE_US;
+        }
+        mockMillis() = UNIO::clock() / 1000;
+        written[value] = UNIO::clock();
+        EEPROM->put(POWERFAIL_ADDRESS, record);
+        if (mode.fence) {
+            EEPROM->put(POWERFAIL_COPY, record);
+        }
+        if (mode.fence && (value & 1)) {
+            // The copy has to be on the chip before the number is.  It is
+            // only every other update, so the copy changes again while the
+            // number is still waiting.
+            EEPROM->fence();
+            EEPROM->put(POWERFAIL_HEADER, value);
+            EEPROM->fence();
+        }
+        if (mode.flushEach) {
+            EEPROM->flush();
+        } else {
+            for (index = 0; index < 4; index++) {
+                EEPROM->commit();
+            }
+        }
+        if (!UNIO::powered()) {
+            break;
+        }
+        if (EEPROM->isDurable(EEPROM->sequence())) {
+            acked = value;
+        }
+    }
+    if (UNIO::powered()) {
+        // The cut came after the last update
+        UNIO::power_on();
+        delete EEPROM;
+        return;
+    }
+    cut = UNIO::clock();
+    delete EEPROM;
+
+    UNIO::power_on();
+    start = UNIO::clock();
+    EEPROM = boot(mode, &unio, &mirror);
+    start = UNIO::clock() - start;
+    EEPROM->get(POWERFAIL_ADDRESS, record);
+    if (mode.fence) {
+        EEPROM->get(POWERFAIL_COPY, copy);
+        EEPROM->get(POWERFAIL_HEADER, header);
+    }
+    delete EEPROM;
+
+    stats.cycles++;
+    if ((copy.inv == ~copy.value) && (header > copy.value)) {
+        stats.order++;
+    }
+    stats.recovery += start;
+    if (start > stats.recoveryMax) {
+        stats.recoveryMax = start;
+    }
+    if ((record.inv != ~record.value) || (record.value > value)) {
+        stats.torn++;
+        stats.ackedLost += (acked > 0) ? 1 : 0;
+        return;
+    }
+    if (record.value < acked) {
+        stats.ackedLost++;
+    }
+    if (record.value < value) {
+        stats.lost += value - record.value;
+        if ((value - record.value) > stats.lostMax) {
+            stats.lostMax = value - record.value;
+        }
+        stats.window += cut - written[record.value + 1];
+        if ((cut - written[record.value + 1]) > stats.windowMax) {
+            stats.windowMax = cut - written[record.value + 1];
+        }
+    }
+}
+
+static void run(const Mode &mode, uint32_t cycles, uint32_t seed, Stats &stats)
+{
+    std::mt19937 rng(seed);
+    uint32_t index;
+    for (index = 0; index < cycles; index++) {
+        cycle(mode, rng, stats);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t cycles = (argc > 1) ? strtoul(argv[1], NULL, 0) : POWERFAIL_CYCLES;
+    uint32_t threads = std::thread::hardware_concurrency();
+    uint32_t index, thread;
+    if (threads == 0) {
+        threads = 1;
+    }
+    printf("UNIO_EEPROM power fail (%" PRIu32 " cycles a mode on %" PRIu32 " threads)\n", cycles, threads);
+    printf("%-22s %7s %6s %6s %6s %13s %19s %19s\n", "", "cycles", "torn", "acked", "order",
+           "lost updates", "loss window (ms)", "begin() (ms)");
+    printf("%-22s %7s %6s %6s %6s %13s %19s %19s\n", "", "", "", "lost", "", "mean   max", "mean   max",
+           "mean   max");
+    for (index = 0; index < sizeof(modes) / sizeof(modes[0]); index++) {
+        std::vector<Stats> stats(threads);
+        std::vector<std::thread> pool;
+        Stats total = Stats();
+        for (thread = 0; thread < threads; thread++) {
+            stats[thread] = Stats();
+            pool.push_back(std::thread(run, std::cref(modes[index]), (cycles + thread) / threads,
+                                       (index << 8) + thread, std::ref(stats[thread])));
+        }
+        for (thread = 0; thread < threads; thread++) {
+            pool[thread].join();
+            total.cycles += stats[thread].cycles;
+            total.torn += stats[thread].torn;
+            total.ackedLost += stats[thread].ackedLost;
+            total.order += stats[thread].order;
+            total.lost += stats[thread].lost;
+            total.window += stats[thread].window;
+            total.recovery += stats[thread].recovery;
+            total.lostMax = std::max(total.lostMax, stats[thread].lostMax);
+            total.windowMax = std::max(total.windowMax, stats[thread].windowMax);
+            total.recoveryMax = std::max(total.recoveryMax, stats[thread].recoveryMax);
+        }
+        if (total.cycles == 0) {
+            total.cycles = 1;
+        }
+        printf("%-22s %7" PRIu32 " %6" PRIu32 " %6" PRIu32 " %6" PRIu32 " %6.2f %6" PRIu32 " %12.1f %6.1f %12.1f %6.1f\n",
+               modes[index].name, total.cycles, total.torn, total.ackedLost, total.order,
+               (double) total.lost / total.cycles, total.lostMax,
+               (double) total.window / total.cycles / 1000.0, total.windowMax / 1000.0,
+               (double) total.recovery / total.cycles / 1000.0, total.recoveryMax / 1000.0);
+    }
+    return 0;
+}
@@ -0,0 +1,224 @@
+/**
+ * @file       test/replay_unio_eeprom.cpp
+ * @author     Scott L. Price <prices@hugllc.com>
+ * @copyright  © 2016 Hunt Utilities Group, LLC
+ * @brief   Replays a UNIO_EEPROM_TRACE trace through the cache
+ * @details
+ *
+ * Usage: run_replay [trace]
+ *
+ * The trace is the bytes traceRead() gave, as sent over serial from a device
+ * built with UNIO_EEPROM_TRACE.  Without one, this records a trace of a
+ * made up hour of a counter, a config struct and commit() calls, the same
+ * way, and replays that.
+ *
+ * The trace is run through the cache and UNIO mock for each set up below, at
+ * the times it was recorded.  It reports the page writes, the bus time, the
+ * longest bus time spent in one call (how long the caller is held up) and
+ * how long changes took to be on the chip.
+ *
+ */
+/*
+ *
+ */
+#include <stdio.h>
+#include <inttypes.h>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include "Arduino.h"
+#include "UNIO.h"
+#include "UNIO_EEPROM.h"
+
+#define REPLAY_HOUR_MS 3600000UL
+
+/**
+ * One event from the trace
+ */
+struct Event {
+    uint8_t call;
+    uint8_t length;
+    uint16_t address;
+    uint32_t time;
+};
+
+/**
+ * How the cache is set up for a replay
+ */
+struct Setup {
+    const char *name;
+    uint8_t writeMode;
+    uint32_t deadline;
+    bool flushOnCommit;
+};
+
+static const Setup setups[] = {
+    { "as recorded", UNIO_WRITE_BACK, 0, false },
+    { "flush() for commit()", UNIO_WRITE_BACK, 0, true },
+    { "deadline 1 s", UNIO_WRITE_BACK, 1000, false },
+    { "deadline 10 s", UNIO_WRITE_BACK, 10000, false },
+    { "write through", UNIO_WRITE_THROUGH, 0, false },
+};
+
+static void decode(const uint8_t *record, std::vector<Event> &trace)
+{
+    Event event;
+    event.call = record[0];
+    event.length = record[1];
+    event.address = record[2] | (record[3] << 8);
+    event.time = record[4] | (record[5] << 8) | ((uint32_t)record[6] << 16) | ((uint32_t)record[7] << 24);
+    trace.push_back(event);
+}
+
+static bool load(const char *name, std::vector<Event> &trace)
+{
+    uint8_t record[UNIO_TRACE_RECORD];
+    FILE *file = fopen(name, "rb");
+    if (!file) {
+        return false;
+    }
+    while (fread(record, 1, sizeof(record), file) == sizeof(record)) {
+        decode(record, trace);
+    }
+    fclose(file);
+    return !trace.empty();
+}
+
+/**
+ * Records an hour of a made up device, draining the trace as it goes like
+ * the serial loop on a device would.
+ */
+static void record(std::vector<Event> &trace)
+{
+    UNIO unio(0, EEPROM_SIZE);
+    UNIOEEPROMClass EEPROM(&unio, EEPROM_SIZE);
+    uint8_t buffer[UNIO_EEPROM_TRACE * UNIO_TRACE_RECORD];
+    uint8_t config[24];
+    uint32_t count = 0;
+    size_t length, index;
+    memset(config, 0, sizeof(config));
+    EEPROM.begin();
+    for (mockMillis() = 0; mockMillis() < REPLAY_HOUR_MS; mockMillis() += 100) {
+        if ((mockMillis() % 1000) == 0) {
+            EEPROM.put(0, ++count);
+        }
+        if ((mockMillis() % 60000) == 0) {
+            // A burst of settings changes
+            for (index = 0; index < 3; index++) {
+                config[(count + index * 7) % sizeof(config)]++;
+                EEPROM.put(40, config);
+            }
+        }
+        if ((mockMillis() % 300000) == 0) {
+            EEPROM.write(100 + (count % 16), (uint8_t) count);
+        }
+        EEPROM.commit();
+        length = EEPROM.traceRead(buffer, sizeof(buffer));
+        for (index = 0; index < length; index += UNIO_TRACE_RECORD) {
+            decode(&buffer[index], trace);
+        }
+    }
+    mockMillis() = 0;
+}
+
+static void replay(const Setup &setup, const std::vector<Event> &trace)
+{
+    UNIO unio(0, EEPROM_SIZE);
+    UNIOEEPROMClass EEPROM(&unio, EEPROM_SIZE);
+    std::deque<std::pair<uint32_t, uint32_t> > pending;
+    uint8_t data[0x100];
+    uint32_t last = trace[0].time, bus = 0, busMax = 0, cost;
+    uint32_t durable, changes = 0, waitMax = 0;
+    uint64_t wait = 0;
+    size_t index;
+    mockMillis() = last;
+    EEPROM.begin();
+    EEPROM.setWriteMode(setup.writeMode);
+    EEPROM.setDirtyDeadline(setup.deadline);
+    unio.writecounter = 0;
+    for (index = 0; index < trace.size(); index++) {
+        const Event &event = trace[index];
+        if ((event.address + event.length) > EEPROM_SIZE) {
+            continue;
+        }
+        // Write cycles run on while the device does other things
+        UNIO::clock() += (event.time - last) * 1000;
+        mockMillis() = last = event.time;
+        memset(data, (uint8_t)(index + 1), event.length);
+        cost = unio.bustime;
+        switch (event.call) {
+        case UNIO_TRACE_READ:
+            EEPROM.read(event.address);
+            break;
+        case UNIO_TRACE_GET:
+            EEPROM.readBytes(event.address, data, event.length);
+            break;
+        case UNIO_TRACE_WRITE:
+            EEPROM.write(event.address, data[0]);
+            break;
+        case UNIO_TRACE_PUT:
+        case UNIO_TRACE_BLOCK:
+            EEPROM.writeBytes(event.address, data, event.length);
+            break;
+        case UNIO_TRACE_COMMIT:
+            if (setup.flushOnCommit) {
+                EEPROM.flush();
+            } else {
+                EEPROM.commit();
+            }
+            break;
+        case UNIO_TRACE_FLUSH:
+            EEPROM.flush();
+            break;
+        }
+        cost = unio.bustime - cost;
+        bus += cost;
+        busMax = std::max(busMax, cost);
+        if ((event.call == UNIO_TRACE_WRITE) || (event.call == UNIO_TRACE_PUT)
+            || (event.call == UNIO_TRACE_BLOCK)) {
+            pending.push_back(std::make_pair(EEPROM.sequence(), event.time));
+        }
+        // Asking the chip is not something the device did, so its bus time
+        // is left out
+        durable = pending.empty() ? 0 : EEPROM.durableSequence();
+        while (!pending.empty() && (pending.front().first <= durable)) {
+            wait += event.time - pending.front().second;
+            waitMax = std::max(waitMax, event.time - pending.front().second);
+            pending.pop_front();
+            changes++;
+        }
+    }
+    // Whatever is left goes out at the end
+    EEPROM.flush();
+    while (!pending.empty()) {
+        wait += last - pending.front().second;
+        waitMax = std::max(waitMax, last - pending.front().second);
+        pending.pop_front();
+        changes++;
+    }
+    printf("%-22s %12" PRIu32 " %12.1f %12.1f %12.1f %10" PRIu32 "\n", setup.name, unio.writecounter,
+           bus / 1000.0, busMax / 1000.0, changes ? (double) wait / changes : 0.0, waitMax);
+    mockMillis() = 0;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<Event> trace;
+    size_t index;
+    if (argc > 1) {
+        if (!load(argv[1], trace)) {
+            fprintf(stderr, "No events in %s\n", argv[1]);
+            return 1;
+        }
+    } else {
+        record(trace);
+    }
+    printf("UNIO_EEPROM replay (%zu events over %.1f s)\n", trace.size(),
+           (trace.back().time - trace.front().time) / 1000.0);
+    printf("%-22s %12s %12s %12s %12s %10s\n", "", "page writes", "bus (ms)", "longest (ms)",
+           "durable (ms)", "max (ms)");
+    for (index = 0; index < sizeof(setups) / sizeof(setups[0]); index++) {
+        replay(setups[index], trace);
+    }
+    return 0;
+}
@@ -15,7 +15,89 @@
 #include <stdio.h>
 #include <inttypes.h>
 #include <cmath>
+#include "Arduino.h"
 #include "main.h"
+#include "UNIO_EEPROM_Impl.h"
+#include "UNIO_EEPROM_File.h"
+
+/**
+ * Records the events from UNIOEEPROMClass
+ */
+struct EventLog {
+    uint8_t count;
+    uint8_t event[16];
+    int page[16];
+};
+static void logEvent(uint8_t event, int page, uint32_t time, void *arg)
+{
+    EventLog *log = (EventLog *)arg;
+    if (log->count < 16) {
+        log->event[log->count] = event;
+        log->page[log->count] = page;
+        log->count++;
+    }
+}
+
+/**
+ * Widens a uint16_t to a uint32_t
+ */
+static void widen(const uint8_t *from, uint8_t *to, uint16_t length)
+{
+    uint16_t old;
+    uint32_t value;
+    memcpy(&old, from, sizeof(old));
+    value = old;
+    memcpy(to, &value, sizeof(value));
+}
+
+/**
+ * Version 1 has a uint16_t at 16, a uint32_t at 20 and 20 bytes at 32.
+ * Version 2 has them at 64 (as a uint32_t), 68 and 40.  The header is at 96.
+ */
+static const UNIOEEPROMMigration schemaV1[] = {
+    { UNIO_MIGRATE_TRANSFORM, 64, 16, 4, widen },
+    { UNIO_MIGRATE_COPY, 68, 20, 4, NULL },
+    { UNIO_MIGRATE_COPY, 40, 32, 20, NULL },
+    { UNIO_MIGRATE_FILL, 16, 0, 8, NULL },
+};
+
+static void schemaSetup(UNIO *unio)
+{
+    UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+    UNIOEEPROMSchema *schema = new UNIOEEPROMSchema(EEPROM, 1, UNIOEEPROMSchema::hash("v1"), 96);
+    uint16_t index;
+    EEPROM->begin();
+    schema->begin();
+    EEPROM->put(16, (uint16_t)0x1234);
+    EEPROM->put(20, (uint32_t)0x89ABCDEF);
+    for (index = 0; index < 20; index++) {
+        EEPROM->write(32 + index, index + 1);
+    }
+    EEPROM->flush();
+    delete schema;
+    delete EEPROM;
+}
+
+/**
+ * Checks the fields were moved by schemaV1
+ */
+static bool schemaCheck(UNIOEEPROMClass *EEPROM)
+{
+    uint32_t value;
+    uint16_t index;
+    bool ret = true;
+    EEPROM->get(64, value);
+    ret = ret && (value == 0x1234);
+    EEPROM->get(68, value);
+    ret = ret && (value == 0x89ABCDEF);
+    for (index = 0; index < 20; index++) {
+        ret = ret && (EEPROM->read(40 + index) == (index + 1));
+    }
+    for (index = 16; index < 24; index++) {
+        ret = ret && (EEPROM->read(index) == 0);
+    }
+    return ret;
+}
 
 FCTMF_FIXTURE_SUITE_BGN(test_unio_eeprom)
 {
@@ -906,6 +988,2604 @@ FCTMF_FIXTURE_SUITE_BGN(test_unio_eeprom)
         delete unio;
     }
     FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(maxDirtyAge() returns 0 when nothing is dirty) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint32_t value;
+        uint32_t expect = 0;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        mockMillis() = 1000;
+        value = EEPROM->maxDirtyAge();
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(oldestDirtyPage() returns -1 when nothing is dirty) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        int value;
+        int expect = -1;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        value = EEPROM->oldestDirtyPage();
+        fct_xchk(value == expect, "Expected %d got %d", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(maxDirtyAge() counts from when the page first went dirty) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint32_t value;
+        uint32_t expect = 200;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        mockMillis() = 100;
+        EEPROM->write(3, 1);
+        mockMillis() = 150;
+        EEPROM->write(4, 1);
+        mockMillis() = 300;
+        value = EEPROM->maxDirtyAge();
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(oldestDirtyPage() returns the page that went dirty first) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        int value;
+        int expect = 5;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        mockMillis() = 100;
+        EEPROM->write(5 * UNIO_PAGE_SIZE, 1);
+        mockMillis() = 150;
+        EEPROM->write(0, 1);
+        EEPROM->write(5 * UNIO_PAGE_SIZE + 1, 1);
+        value = EEPROM->oldestDirtyPage();
+        fct_xchk(value == expect, "Expected %d got %d", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(commit() with a deadline holds young pages back) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint16_t index;
+        uint32_t value;
+        uint32_t expect = 0;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->setDirtyDeadline(100);
+        mockMillis() = 1000;
+        EEPROM->write(0, 1);
+        mockMillis() = 1049;
+        for (index = 0; index < (EEPROM->pages() * 2); index++) {
+            EEPROM->commit();
+        }
+        value = unio->writecounter;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(commit() with a deadline writes the oldest page first) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint8_t value;
+        uint8_t expect = 0xFF;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->setDirtyDeadline(100);
+        mockMillis() = 1000;
+        EEPROM->write(6 * UNIO_PAGE_SIZE, 1);
+        mockMillis() = 1010;
+        EEPROM->write(0, 1);
+        mockMillis() = 1060;
+        EEPROM->commit();
+        value = unio->get(6 * UNIO_PAGE_SIZE);
+        expect = 1;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = unio->get(0);
+        expect = 0xFF;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = EEPROM->oldestDirtyPage();
+        expect = 0;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(view() points into the cache) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        const uint32_t *value;
+        uint32_t expect = 0x27262524;
+        int16_t addr = 36;
+        unio->incrementPattern();
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        value = EEPROM->view<uint32_t>(addr);
+        fct_xchk(value != NULL, "Expected a pointer got NULL");
+        if (value != NULL) {
+            fct_xchk(*value == expect, "Expected %u got %u", expect, *value);
+        }
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(view() returns NULL with an out of range address) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        const uint32_t *value;
+        int16_t addr = EEPROM_SIZE + 4;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        value = EEPROM->view<uint32_t>(addr);
+        fct_xchk(value == NULL, "Expected NULL got a pointer");
+        value = EEPROM->view<uint32_t>(-4);
+        fct_xchk(value == NULL, "Expected NULL got a pointer");
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(view() returns NULL with a misaligned address) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        const uint32_t *value;
+        int16_t addr = 37;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        value = EEPROM->view<uint32_t>(addr);
+        fct_xchk(value == NULL, "Expected NULL got a pointer");
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(edit() changes the cache and dirties every page under it) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint16_t index;
+        uint32_t value;
+        uint32_t expect = 2;
+        int16_t addr = 24;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        {
+            UNIOEEPROMEdit<uint8_t[24]> data = EEPROM->edit<uint8_t[24]>(addr);
+            fct_xchk(data.valid(), "Expected valid got invalid");
+            for (index = 0; index < 24; index++) {
+                (*data)[index] = index;
+            }
+        }
+        EEPROM->flush();
+        value = unio->writecounter;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        for (index = 0; index < 24; index++) {
+            value = unio->get(addr + index);
+            fct_xchk(value == index, "Address %u Expected %u got %u", addr + index, index, value);
+        }
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(edit() with an out of range address is invalid and dirties nothing) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        int value;
+        int expect = -1;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        {
+            UNIOEEPROMEdit<uint32_t> data = EEPROM->edit<uint32_t>(EEPROM_SIZE);
+            fct_xchk(!data.valid(), "Expected invalid got valid");
+        }
+        value = EEPROM->oldestDirtyPage();
+        fct_xchk(value == expect, "Expected %d got %d", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(readBytes() reads the whole device) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint8_t buffer[EEPROM_SIZE];
+        uint16_t index;
+        bool ret;
+        bool retExpect = true;
+        uint8_t value, expect;
+        unio->incrementPattern();
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        ret = EEPROM->readBytes(0, buffer, sizeof(buffer));
+        fct_xchk(ret == retExpect, "Expected %s got %s", retExpect ? "TRUE" : "FALSE", ret ? "TRUE" : "FALSE");
+        for (index = 0; index < sizeof(buffer); index++) {
+            value = buffer[index];
+            expect = index & 0xFF;
+            fct_xchk(value == expect, "Address: %u Expected %u got %u", index, expect, value);
+        }
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(readBytes() returns false when it runs off the end) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint8_t buffer[8];
+        bool ret;
+        bool retExpect = false;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        ret = EEPROM->readBytes(EEPROM_SIZE - 4, buffer, sizeof(buffer));
+        fct_xchk(ret == retExpect, "Expected %s got %s", retExpect ? "TRUE" : "FALSE", ret ? "TRUE" : "FALSE");
+        ret = EEPROM->readBytes(0, NULL, sizeof(buffer));
+        fct_xchk(ret == retExpect, "Expected %s got %s", retExpect ? "TRUE" : "FALSE", ret ? "TRUE" : "FALSE");
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(writeBytes() only writes the pages that changed) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint8_t buffer[40];
+        uint16_t index;
+        uint32_t value;
+        uint32_t expect = 2;
+        int16_t addr = 5;
+        memset(buffer, 0xFF, sizeof(buffer));
+        buffer[0] = 1;
+        buffer[39] = 2;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->writeBytes(addr, buffer, sizeof(buffer));
+        EEPROM->flush();
+        value = unio->writecounter;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        for (index = 0; index < sizeof(buffer); index++) {
+            value = unio->get(addr + index);
+            expect = buffer[index];
+            fct_xchk(value == expect, "Address: %u Expected %u got %u", addr + index, expect, value);
+        }
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(writeBytes() writes the last byte of the device) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint8_t buffer[2] = { 0x12, 0x34 };
+        bool ret;
+        bool retExpect = true;
+        uint8_t value;
+        uint8_t expect = 0x34;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        ret = EEPROM->writeBytes(EEPROM_SIZE - 2, buffer, sizeof(buffer));
+        fct_xchk(ret == retExpect, "Expected %s got %s", retExpect ? "TRUE" : "FALSE", ret ? "TRUE" : "FALSE");
+        EEPROM->flush();
+        value = unio->get(EEPROM_SIZE - 1);
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(put() dirties both pages when it straddles a page boundary) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint32_t value;
+        uint32_t expect = 0x12345678;
+        int16_t addr = UNIO_PAGE_SIZE - 2;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->put(addr, expect);
+        EEPROM->flush();
+        value = unio->get(addr) | (unio->get(addr + 1) << 8) | (unio->get(addr + 2) << 16) | (unio->get(addr + 3) << 24);
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(fill() only dirties pages that are not already the value) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint16_t index;
+        uint32_t value;
+        uint32_t expect = 1;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->write(40, 0);
+        EEPROM->flush();
+        unio->writecounter = 0;
+        EEPROM->fill(0, 0xFF, EEPROM_SIZE);
+        EEPROM->flush();
+        value = unio->writecounter;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        for (index = 0; index < EEPROM_SIZE; index++) {
+            value = unio->get(index);
+            fct_xchk(value == 0xFF, "Address: %u Expected %u got %u", index, 0xFF, value);
+        }
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(equals() compares against the cache) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint8_t buffer[37];
+        uint16_t index;
+        bool ret;
+        bool retExpect;
+        int16_t addr = 3;
+        unio->incrementPattern();
+        for (index = 0; index < sizeof(buffer); index++) {
+            buffer[index] = addr + index;
+        }
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        ret = EEPROM->equals(addr, buffer, sizeof(buffer));
+        retExpect = true;
+        fct_xchk(ret == retExpect, "Expected %s got %s", retExpect ? "TRUE" : "FALSE", ret ? "TRUE" : "FALSE");
+        buffer[36] = 0;
+        ret = EEPROM->equals(addr, buffer, sizeof(buffer));
+        retExpect = false;
+        fct_xchk(ret == retExpect, "Expected %s got %s", retExpect ? "TRUE" : "FALSE", ret ? "TRUE" : "FALSE");
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(clear() never rewrites fresh pages) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        int ret;
+        int retExpect = EEPROM_SIZE / UNIO_PAGE_SIZE;
+        uint32_t value;
+        uint32_t expect = 0;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        ret = EEPROM->clear();
+        fct_xchk(ret == retExpect, "Expected %d got %d", retExpect, ret);
+        EEPROM->flush();
+        value = unio->writecounter;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(clear() never rewrites fresh pages after beginAsync()) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        int ret;
+        int retExpect = EEPROM_SIZE / UNIO_PAGE_SIZE;
+        uint32_t value;
+        uint32_t expect = 0;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->beginAsync();
+        ret = EEPROM->clear();
+        fct_xchk(ret == retExpect, "Expected %d got %d", retExpect, ret);
+        EEPROM->flush();
+        value = unio->writecounter;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(clear() sets every byte and reports the pages skipped) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint16_t index;
+        int ret;
+        int retExpect = (EEPROM_SIZE / UNIO_PAGE_SIZE) - 2;
+        uint32_t value;
+        uint32_t expect = 2;
+        for (index = 0; index < EEPROM_SIZE; index++) {
+            unio->set(index, 0);
+        }
+        unio->set(3, 1);
+        unio->set(UNIO_PAGE_SIZE * 2 + 15, 0xFF);
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        ret = EEPROM->clear(0);
+        fct_xchk(ret == retExpect, "Expected %d got %d", retExpect, ret);
+        EEPROM->flush();
+        value = unio->writecounter;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        for (index = 0; index < EEPROM_SIZE; index++) {
+            value = unio->get(index);
+            fct_xchk(value == 0, "Address: %u Expected %u got %u", index, 0, value);
+        }
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(fillRange() returns -1 with a bad range) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        int ret;
+        int retExpect = -1;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        ret = EEPROM->fillRange(EEPROM_SIZE - 1, 0, 2);
+        fct_xchk(ret == retExpect, "Expected %d got %d", retExpect, ret);
+        ret = EEPROM->fillRange(-1, 0, 2);
+        fct_xchk(ret == retExpect, "Expected %d got %d", retExpect, ret);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(discard() reverts the dirty pages) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint16_t index;
+        uint8_t value, expect;
+        unio->incrementPattern();
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->fill(10, 0, 50);
+        EEPROM->write(100, 0);
+        EEPROM->discard();
+        for (index = 0; index < EEPROM_SIZE; index++) {
+            value = EEPROM->read(index);
+            expect = index & 0xFF;
+            fct_xchk(value == expect, "Address: %u Expected %u got %u", index, expect, value);
+        }
+        index = EEPROM->oldestDirtyPage();
+        fct_xchk((int16_t)index == -1, "Expected no dirty pages got %d", (int16_t)index);
+        EEPROM->flush();
+        fct_xchk(unio->writecounter == 0, "Expected %u got %u", 0, unio->writecounter);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(discard() reads each run of dirty pages once) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint32_t value;
+        uint32_t expect = 2;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        unio->readcounter = 0;
+        EEPROM->fill(10, 0, 50);
+        EEPROM->write(100, 0);
+        EEPROM->discard();
+        value = unio->readcounter;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(discardRange() leaves pages outside the range alone) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint8_t value, expect;
+        bool ret;
+        bool retExpect = true;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->write(0, 1);
+        EEPROM->write(UNIO_PAGE_SIZE, 2);
+        ret = EEPROM->discardRange(UNIO_PAGE_SIZE, 1);
+        fct_xchk(ret == retExpect, "Expected %s got %s", retExpect ? "TRUE" : "FALSE", ret ? "TRUE" : "FALSE");
+        value = EEPROM->read(0);
+        expect = 1;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = EEPROM->read(UNIO_PAGE_SIZE);
+        expect = 0xFF;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        EEPROM->flush();
+        value = unio->get(0);
+        expect = 1;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(discardRange() returns false with a bad range) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        bool ret;
+        bool retExpect = false;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        ret = EEPROM->discardRange(EEPROM_SIZE, 1);
+        fct_xchk(ret == retExpect, "Expected %s got %s", retExpect ? "TRUE" : "FALSE", ret ? "TRUE" : "FALSE");
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(reload() picks up changes made behind its back in one read) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint16_t index;
+        int ret;
+        int retExpect = 0;
+        uint32_t value, expect;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        unio->incrementPattern();
+        unio->readcounter = 0;
+        ret = EEPROM->reload(20, 40);
+        fct_xchk(ret == retExpect, "Expected %d got %d", retExpect, ret);
+        value = unio->readcounter;
+        expect = 1;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        for (index = 0; index < EEPROM_SIZE; index++) {
+            value = EEPROM->read(index);
+            expect = ((index >= UNIO_PAGE_SIZE) && (index < 4 * UNIO_PAGE_SIZE)) ? index : 0xFF;
+            fct_xchk(value == expect, "Address: %u Expected %u got %u", index, expect, value);
+        }
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(reload() keeps dirty pages by default) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        int ret;
+        int retExpect = 1;
+        uint8_t value, expect;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->write(UNIO_PAGE_SIZE, 1);
+        unio->incrementPattern();
+        ret = EEPROM->reload(0, EEPROM_SIZE);
+        fct_xchk(ret == retExpect, "Expected %d got %d", retExpect, ret);
+        value = EEPROM->read(UNIO_PAGE_SIZE);
+        expect = 1;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = EEPROM->read(UNIO_PAGE_SIZE + 1);
+        expect = 0xFF;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = EEPROM->read(2 * UNIO_PAGE_SIZE);
+        expect = 2 * UNIO_PAGE_SIZE;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        ret = EEPROM->oldestDirtyPage();
+        fct_xchk(ret == 1, "Expected %d got %d", 1, ret);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(reload() can take the device copy of dirty pages) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        int ret;
+        int retExpect = 1;
+        uint8_t value, expect;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->write(UNIO_PAGE_SIZE, 1);
+        unio->incrementPattern();
+        ret = EEPROM->reload(0, EEPROM_SIZE, UNIO_RELOAD_DEVICE);
+        fct_xchk(ret == retExpect, "Expected %d got %d", retExpect, ret);
+        value = EEPROM->read(UNIO_PAGE_SIZE);
+        expect = UNIO_PAGE_SIZE;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        ret = EEPROM->oldestDirtyPage();
+        fct_xchk(ret == -1, "Expected %d got %d", -1, ret);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(reload() can report a conflict and change nothing) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        int ret;
+        int retExpect = 1;
+        uint8_t value, expect;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->write(UNIO_PAGE_SIZE, 1);
+        unio->incrementPattern();
+        unio->readcounter = 0;
+        ret = EEPROM->reload(0, EEPROM_SIZE, UNIO_RELOAD_CONFLICT);
+        fct_xchk(ret == retExpect, "Expected %d got %d", retExpect, ret);
+        value = EEPROM->read(2 * UNIO_PAGE_SIZE);
+        expect = 0xFF;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        fct_xchk(unio->readcounter == 0, "Expected %u got %u", 0, unio->readcounter);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(begin() reads in chunks of maxReadChunk()) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint16_t index;
+        uint32_t value, expect;
+        unio->incrementPattern();
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->setMaxReadChunk(40);
+        EEPROM->begin();
+        value = unio->readcounter;
+        expect = EEPROM_SIZE / 32;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        for (index = 0; index < EEPROM_SIZE; index++) {
+            value = EEPROM->read(index);
+            expect = index & 0xFF;
+            fct_xchk(value == expect, "Address: %u Expected %u got %u", index, expect, value);
+        }
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(setMaxReadChunk() smaller than a page reads a page at a time) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint32_t value, expect;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->setMaxReadChunk(1);
+        EEPROM->begin();
+        value = unio->readcounter;
+        expect = EEPROM_SIZE / UNIO_PAGE_SIZE;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(discard() merges adjacent dirty pages up to maxReadChunk()) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint32_t value, expect;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->setMaxReadChunk(2 * UNIO_PAGE_SIZE);
+        EEPROM->fill(0, 0, 5 * UNIO_PAGE_SIZE);
+        EEPROM->write(7 * UNIO_PAGE_SIZE, 0);
+        unio->readcounter = 0;
+        EEPROM->discard();
+        value = unio->readcounter;
+        expect = 4;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = EEPROM->read(4 * UNIO_PAGE_SIZE);
+        expect = 0xFF;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(beginAsync() does not read anything) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint32_t value;
+        uint32_t expect = 0;
+        bool ret;
+        bool retExpect = false;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->beginAsync();
+        value = unio->readcounter;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        ret = EEPROM->loaded();
+        fct_xchk(ret == retExpect, "Expected %s got %s", retExpect ? "TRUE" : "FALSE", ret ? "TRUE" : "FALSE");
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(poll() loads the cache a chunk at a time) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint16_t index;
+        uint32_t value, expect;
+        bool ret;
+        unio->incrementPattern();
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->beginAsync(32);
+        for (index = 1; index < (EEPROM_SIZE / 32); index++) {
+            ret = EEPROM->poll();
+            fct_xchk(!ret, "Poll %u: Expected FALSE got TRUE", index);
+        }
+        ret = EEPROM->poll();
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        fct_xchk(EEPROM->loaded(), "Expected TRUE got FALSE");
+        value = unio->readcounter;
+        expect = EEPROM_SIZE / 32;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        for (index = 0; index < EEPROM_SIZE; index++) {
+            value = EEPROM->read(index);
+            expect = index & 0xFF;
+            fct_xchk(value == expect, "Address: %u Expected %u got %u", index, expect, value);
+        }
+        value = unio->readcounter;
+        expect = EEPROM_SIZE / 32;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(read() before poll() gets there loads just that page) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint32_t value, expect;
+        uint16_t index;
+        unio->incrementPattern();
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->beginAsync(EEPROM_SIZE);
+        value = EEPROM->read(3 * UNIO_PAGE_SIZE + 2);
+        expect = 3 * UNIO_PAGE_SIZE + 2;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = unio->readcounter;
+        expect = 1;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        EEPROM->poll();
+        value = unio->readcounter;
+        expect = 3;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        for (index = 0; index < EEPROM_SIZE; index++) {
+            value = EEPROM->read(index);
+            expect = index & 0xFF;
+            fct_xchk(value == expect, "Address: %u Expected %u got %u", index, expect, value);
+        }
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(write() before poll() gets there keeps the rest of the page) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint32_t value, expect;
+        unio->incrementPattern();
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->beginAsync();
+        EEPROM->write(UNIO_PAGE_SIZE * 5, 0);
+        while (!EEPROM->poll());
+        EEPROM->flush();
+        value = unio->get(UNIO_PAGE_SIZE * 5);
+        expect = 0;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = unio->get(UNIO_PAGE_SIZE * 5 + 1);
+        expect = UNIO_PAGE_SIZE * 5 + 1;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(commit() reports the start and end of each page write) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        EventLog log;
+        uint16_t index;
+        memset(&log, 0, sizeof(log));
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->addCallback(logEvent, &log);
+        EEPROM->write(2 * UNIO_PAGE_SIZE, 1);
+        for (index = 0; index < 100; index++) {
+            EEPROM->commit();
+        }
+        fct_xchk(log.count == 2, "Expected %u got %u", 2, log.count);
+        fct_xchk(log.event[0] == UNIO_EVENT_WRITE_START, "Expected %u got %u", UNIO_EVENT_WRITE_START, log.event[0]);
+        fct_xchk(log.page[0] == 2, "Expected %d got %d", 2, log.page[0]);
+        fct_xchk(log.event[1] == UNIO_EVENT_WRITE_DONE, "Expected %u got %u", UNIO_EVENT_WRITE_DONE, log.event[1]);
+        fct_xchk(log.page[1] == 2, "Expected %d got %d", 2, log.page[1]);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(flush() reports each page and then the flush) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        EventLog log;
+        memset(&log, 0, sizeof(log));
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->addCallback(logEvent, &log);
+        EEPROM->write(0, 1);
+        EEPROM->write(3 * UNIO_PAGE_SIZE, 1);
+        EEPROM->flush();
+        fct_xchk(log.count == 5, "Expected %u got %u", 5, log.count);
+        fct_xchk(log.page[2] == 3, "Expected %d got %d", 3, log.page[2]);
+        fct_xchk(log.event[3] == UNIO_EVENT_WRITE_DONE, "Expected %u got %u", UNIO_EVENT_WRITE_DONE, log.event[3]);
+        fct_xchk(log.event[4] == UNIO_EVENT_FLUSH_DONE, "Expected %u got %u", UNIO_EVENT_FLUSH_DONE, log.event[4]);
+        fct_xchk(log.page[4] == -1, "Expected %d got %d", -1, log.page[4]);
+        EEPROM->removeCallback(logEvent);
+        EEPROM->write(0, 2);
+        EEPROM->flush();
+        fct_xchk(log.count == 5, "Expected %u got %u", 5, log.count);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(addCallback() returns false when it is full) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        EventLog log;
+        uint8_t index;
+        bool ret;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        for (index = 0; index < UNIO_EEPROM_CALLBACKS; index++) {
+            ret = EEPROM->addCallback(logEvent, &log);
+            fct_xchk(ret, "Expected TRUE got FALSE");
+        }
+        ret = EEPROM->addCallback(logEvent, &log);
+        fct_xchk(!ret, "Expected FALSE got TRUE");
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(durableSequence() waits for the write cycle to finish) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint32_t seq, value;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->write(0, 1);
+        seq = EEPROM->sequence();
+        fct_xchk(seq == 1, "Expected %u got %u", 1, seq);
+        EEPROM->write(UNIO_PAGE_SIZE, 1);
+        value = EEPROM->durableSequence();
+        fct_xchk(value == 0, "Expected %u got %u", 0, value);
+        EEPROM->commit();
+        value = EEPROM->durableSequence();
+        fct_xchk(value == 0, "Expected %u got %u", 0, value);
+        fct_xchk(!EEPROM->isDurable(seq), "Expected FALSE got TRUE");
+        while (EEPROM->commit() == false);
+        value = EEPROM->durableSequence();
+        fct_xchk(value == 1, "Expected %u got %u", 1, value);
+        fct_xchk(EEPROM->isDurable(seq), "Expected TRUE got FALSE");
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(A short last page is only durable once it is on the chip) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint32_t seq;
+        uint8_t value;
+        bool ret;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, 100);
+        EEPROM->begin();
+        EEPROM->write(97, 5);
+        seq = EEPROM->sequence();
+        fct_xchk(!EEPROM->isDurable(seq), "Expected FALSE got TRUE");
+        ret = EEPROM->flush();
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        value = unio->get(97);
+        fct_xchk(value == 5, "Expected %u got %u", 5, value);
+        value = unio->get(100);
+        fct_xchk(value == 0xFF, "Expected %u got %u", 0xFF, value);
+        ret = EEPROM->waitDurable(seq);
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        fct_xchk(EEPROM->isDurable(seq), "Expected TRUE got FALSE");
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(waitDurable() returns once the change is on the chip) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint32_t seq;
+        uint8_t value;
+        bool ret;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->write(5 * UNIO_PAGE_SIZE, 7);
+        seq = EEPROM->sequence();
+        ret = EEPROM->waitDurable(seq);
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        value = unio->get(5 * UNIO_PAGE_SIZE);
+        fct_xchk(value == 7, "Expected %u got %u", 7, value);
+        fct_xchk(EEPROM->durableSequence() == seq, "Expected %u got %u", seq, EEPROM->durableSequence());
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(waitDurable() returns false when the write fails) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        bool ret;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->write(0, 7);
+        unio->start_write_ret = false;
+        ret = EEPROM->waitDurable(EEPROM->sequence());
+        fct_xchk(!ret, "Expected FALSE got TRUE");
+        unio->start_write_ret = true;
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(commit() writes pages before a fence() first) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        EventLog log;
+        uint16_t index;
+        memset(&log, 0, sizeof(log));
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->addCallback(logEvent, &log);
+        EEPROM->write(5 * UNIO_PAGE_SIZE, 1);
+        EEPROM->write(6 * UNIO_PAGE_SIZE, 1);
+        EEPROM->fence();
+        EEPROM->write(0, 1);
+        for (index = 0; index < 200; index++) {
+            EEPROM->commit();
+        }
+        fct_xchk(log.count == 6, "Expected %u got %u", 6, log.count);
+        fct_xchk(log.page[0] == 5, "Expected %d got %d", 5, log.page[0]);
+        fct_xchk(log.page[2] == 6, "Expected %d got %d", 6, log.page[2]);
+        fct_xchk(log.page[4] == 0, "Expected %d got %d", 0, log.page[4]);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(a page changed after a fence() waits for the pages before it) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        EventLog log;
+        uint16_t index;
+        memset(&log, 0, sizeof(log));
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->addCallback(logEvent, &log);
+        EEPROM->write(0, 1);
+        EEPROM->write(4 * UNIO_PAGE_SIZE, 1);
+        EEPROM->fence();
+        EEPROM->write(1, 1);
+        for (index = 0; index < 200; index++) {
+            EEPROM->commit();
+        }
+        // Page 0 goes out with the first change before the second one
+        fct_xchk(log.count == 6, "Expected %u got %u", 6, log.count);
+        fct_xchk(log.page[0] == 0, "Expected %d got %d", 0, log.page[0]);
+        fct_xchk(log.page[2] == 4, "Expected %d got %d", 4, log.page[2]);
+        fct_xchk(log.page[4] == 0, "Expected %d got %d", 0, log.page[4]);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(flush() writes pages in fence() order) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        EventLog log;
+        memset(&log, 0, sizeof(log));
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->addCallback(logEvent, &log);
+        EEPROM->write(7 * UNIO_PAGE_SIZE, 1);
+        EEPROM->fence();
+        EEPROM->write(3 * UNIO_PAGE_SIZE, 1);
+        EEPROM->fence();
+        EEPROM->write(0, 1);
+        EEPROM->flush();
+        fct_xchk(log.count == 7, "Expected %u got %u", 7, log.count);
+        fct_xchk(log.page[0] == 7, "Expected %d got %d", 7, log.page[0]);
+        fct_xchk(log.page[2] == 3, "Expected %d got %d", 3, log.page[2]);
+        fct_xchk(log.page[4] == 0, "Expected %d got %d", 0, log.page[4]);
+        fct_xchk(log.event[6] == UNIO_EVENT_FLUSH_DONE, "Expected %u got %u", UNIO_EVENT_FLUSH_DONE, log.event[6]);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(a page changed again after a fence() does not jump ahead of the pages after it) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        EventLog log;
+        uint8_t value;
+        memset(&log, 0, sizeof(log));
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->addCallback(logEvent, &log);
+        EEPROM->write(0, 1);
+        EEPROM->fence();
+        EEPROM->write(UNIO_PAGE_SIZE, 2);
+        EEPROM->fence();
+        EEPROM->write(0, 3);
+        // The first change is on the chip, and nothing after it is
+        value = unio->get(0);
+        fct_xchk(value == 1, "Expected %u got %u", 1, value);
+        value = unio->get(UNIO_PAGE_SIZE);
+        fct_xchk(value == 0xFF, "Expected %u got %u", 0xFF, value);
+        EEPROM->flush();
+        fct_xchk(log.count == 7, "Expected %u got %u", 7, log.count);
+        fct_xchk(log.page[0] == 0, "Expected %d got %d", 0, log.page[0]);
+        fct_xchk(log.page[2] == 1, "Expected %d got %d", 1, log.page[2]);
+        fct_xchk(log.page[4] == 0, "Expected %d got %d", 0, log.page[4]);
+        value = unio->get(0);
+        fct_xchk(value == 3, "Expected %u got %u", 3, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(commit() keeps writing other pages when one page fails) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint16_t index;
+        uint32_t value, expect;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        unio->fail_address = 0;
+        EEPROM->write(0, 1);
+        EEPROM->write(UNIO_PAGE_SIZE, 1);
+        EEPROM->write(2 * UNIO_PAGE_SIZE, 1);
+        for (index = 0; index < 200; index++) {
+            EEPROM->commit();
+        }
+        value = unio->get(UNIO_PAGE_SIZE);
+        expect = 1;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = unio->get(2 * UNIO_PAGE_SIZE);
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = EEPROM->pageFailures(0);
+        fct_xchk(value > 0, "Expected > 0 got %u", value);
+        value = EEPROM->oldestDirtyPage();
+        expect = 0;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(commit() quarantines a page after setMaxRetries() failures) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint16_t index;
+        uint32_t value, expect;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->setMaxRetries(3);
+        unio->fail_address = 0;
+        EEPROM->write(0, 1);
+        for (index = 0; index < 1000; index++) {
+            EEPROM->commit();
+        }
+        fct_xchk(EEPROM->isQuarantined(0), "Expected TRUE got FALSE");
+        value = EEPROM->quarantined();
+        expect = 1;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = EEPROM->writeFailures();
+        expect = 3;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        unio->fail_address = -1;
+        for (index = 0; index < 100; index++) {
+            EEPROM->commit();
+        }
+        value = unio->get(0);
+        expect = 0xFF;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        EEPROM->clearFailures();
+        for (index = 0; index < 100; index++) {
+            EEPROM->commit();
+        }
+        value = unio->get(0);
+        expect = 1;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = EEPROM->quarantined();
+        expect = 0;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(flush() returns false and keeps a page that fails dirty) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        bool ret;
+        int value;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        unio->fail_address = UNIO_PAGE_SIZE;
+        EEPROM->write(0, 1);
+        EEPROM->write(UNIO_PAGE_SIZE, 1);
+        ret = EEPROM->flush();
+        fct_xchk(!ret, "Expected FALSE got TRUE");
+        value = EEPROM->oldestDirtyPage();
+        fct_xchk(value == 1, "Expected %d got %d", 1, value);
+        value = unio->get(0);
+        fct_xchk(value == 1, "Expected %d got %d", 1, value);
+        unio->fail_address = -1;
+        ret = EEPROM->flush();
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(write through starts the page write straight away) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint32_t value, expect;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->setWriteMode(UNIO_WRITE_THROUGH);
+        EEPROM->write(3, 9);
+        value = unio->writecounter;
+        expect = 1;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = unio->get(3);
+        expect = 9;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = EEPROM->oldestDirtyPage();
+        fct_xchk((int)value == -1, "Expected %d got %d", -1, (int)value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(write through only covers the range it is set on) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint32_t value, expect;
+        bool ret;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        ret = EEPROM->setWriteMode(2 * UNIO_PAGE_SIZE, UNIO_PAGE_SIZE, UNIO_WRITE_THROUGH);
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        value = EEPROM->writeMode(2 * UNIO_PAGE_SIZE + 5);
+        expect = UNIO_WRITE_THROUGH;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        EEPROM->put(0, (uint32_t)0);
+        value = unio->writecounter;
+        expect = 0;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        EEPROM->put(2 * UNIO_PAGE_SIZE, (uint32_t)0);
+        value = unio->writecounter;
+        expect = 1;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        ret = EEPROM->setWriteMode(0, UNIO_PAGE_SIZE, 7);
+        fct_xchk(!ret, "Expected FALSE got TRUE");
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(write around goes to the device without dirtying the cache) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint8_t buffer[20];
+        uint16_t index;
+        uint32_t value, expect;
+        for (index = 0; index < sizeof(buffer); index++) {
+            buffer[index] = index;
+        }
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->setWriteMode(UNIO_WRITE_AROUND);
+        EEPROM->writeBytes(10, buffer, sizeof(buffer));
+        value = unio->writecounter;
+        expect = 2;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = EEPROM->oldestDirtyPage();
+        fct_xchk((int)value == -1, "Expected %d got %d", -1, (int)value);
+        for (index = 0; index < sizeof(buffer); index++) {
+            value = unio->get(10 + index);
+            fct_xchk(value == index, "Address: %u Expected %u got %u", 10 + index, index, value);
+        }
+        fct_xchk(!EEPROM->loaded(), "Expected FALSE got TRUE");
+        unio->readcounter = 0;
+        value = EEPROM->read(12);
+        expect = 2;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = unio->readcounter;
+        expect = 1;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        // Back on the fast path once both pages are read again
+        fct_xchk(!EEPROM->loaded(), "Expected FALSE got TRUE");
+        EEPROM->read(10 + sizeof(buffer) - 1);
+        fct_xchk(EEPROM->loaded(), "Expected TRUE got FALSE");
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(write around caches the write when the page is already dirty) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint32_t value, expect;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->write(0, 1);
+        EEPROM->setWriteMode(UNIO_WRITE_AROUND);
+        EEPROM->write(1, 2);
+        value = unio->writecounter;
+        expect = 0;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        EEPROM->flush();
+        value = unio->get(1);
+        expect = 2;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = unio->get(0);
+        expect = 1;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(write around skips data that is already on the device) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        int ret;
+        uint32_t value, expect;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->setWriteMode(UNIO_WRITE_AROUND);
+        ret = EEPROM->fillRange(0, 0xFF, EEPROM_SIZE);
+        fct_xchk(ret == EEPROM_SIZE / UNIO_PAGE_SIZE, "Expected %d got %d", EEPROM_SIZE / UNIO_PAGE_SIZE, ret);
+        ret = EEPROM->fillRange(0, 0, 2 * UNIO_PAGE_SIZE);
+        fct_xchk(ret == 0, "Expected %d got %d", 0, ret);
+        value = unio->writecounter;
+        expect = 2;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = unio->get(UNIO_PAGE_SIZE + 3);
+        expect = 0;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(write around does not write the same data again) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint8_t buffer[UNIO_PAGE_SIZE];
+        uint16_t index;
+        int ret;
+        uint32_t value, expect;
+        memset(buffer, 0x5A, sizeof(buffer));
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->setWriteMode(UNIO_WRITE_AROUND);
+        for (index = 0; index < 3; index++) {
+            EEPROM->writeBytes(0, buffer, sizeof(buffer));
+        }
+        value = unio->writecounter;
+        expect = 1;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        for (index = 0; index < 3; index++) {
+            ret = EEPROM->fillRange(UNIO_PAGE_SIZE, 0, UNIO_PAGE_SIZE);
+            fct_xchk(ret == (index ? 1 : 0), "Expected %d got %d", index ? 1 : 0, ret);
+        }
+        value = unio->writecounter;
+        expect = 2;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = EEPROM->read(3);
+        expect = 0x5A;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(programImage() writes the pages that differ and reads them back once) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint8_t image[40];
+        uint16_t index;
+        int ret;
+        uint32_t value, expect;
+        for (index = 0; index < sizeof(image); index++) {
+            image[index] = index;
+        }
+        memset(&image[UNIO_PAGE_SIZE], 0xFF, UNIO_PAGE_SIZE);
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        unio->readcounter = 0;
+        ret = EEPROM->programImage(image, sizeof(image));
+        fct_xchk(ret == 2, "Expected %d got %d", 2, ret);
+        value = unio->writecounter;
+        expect = 2;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = unio->readcounter;
+        expect = 1;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        for (index = 0; index < sizeof(image); index++) {
+            value = unio->get(index);
+            fct_xchk(value == image[index], "Address: %u Expected %u got %u", index, image[index], value);
+        }
+        value = unio->get(sizeof(image));
+        expect = 0xFF;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        ret = EEPROM->programImage(image, sizeof(image));
+        fct_xchk(ret == 0, "Expected %d got %d", 0, ret);
+        value = EEPROM->oldestDirtyPage();
+        fct_xchk((int)value == -1, "Expected %d got %d", -1, (int)value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(programImage() writes a short last page without going past the cache) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint8_t image[100];
+        uint16_t index;
+        int ret;
+        uint32_t value, expect;
+        for (index = 0; index < sizeof(image); index++) {
+            image[index] = index;
+        }
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, sizeof(image));
+        EEPROM->begin();
+        ret = EEPROM->programImage(image, sizeof(image));
+        expect = (sizeof(image) + UNIO_PAGE_SIZE - 1) / UNIO_PAGE_SIZE;
+        fct_xchk(ret == (int)expect, "Expected %d got %d", (int)expect, ret);
+        for (index = 0; index < sizeof(image); index++) {
+            value = unio->get(index);
+            fct_xchk(value == image[index], "Address: %u Expected %u got %u", index, image[index], value);
+        }
+        value = unio->get(sizeof(image));
+        expect = 0xFF;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(programImage() returns -1 and leaves a page that fails dirty) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint8_t image[2 * UNIO_PAGE_SIZE];
+        int ret;
+        memset(image, 0, sizeof(image));
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        unio->fail_address = UNIO_PAGE_SIZE;
+        ret = EEPROM->programImage(image, sizeof(image));
+        fct_xchk(ret == -1, "Expected %d got %d", -1, ret);
+        ret = EEPROM->oldestDirtyPage();
+        fct_xchk(ret == 1, "Expected %d got %d", 1, ret);
+        ret = EEPROM->programImage(image, EEPROM_SIZE + 1);
+        fct_xchk(ret == -1, "Expected %d got %d", -1, ret);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(applyPatch() applies an encoded patch and dirties only changed pages) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint8_t from[EEPROM_SIZE], to[EEPROM_SIZE], patch[64];
+        uint16_t index;
+        size_t length;
+        bool ret;
+        uint32_t value, expect;
+        unio->incrementPattern();
+        for (index = 0; index < EEPROM_SIZE; index++) {
+            from[index] = index;
+        }
+        memcpy(to, from, sizeof(to));
+        to[3] = 0x55;
+        to[5] = 0x66;
+        memset(&to[2 * UNIO_PAGE_SIZE + 4], 0, 20);
+        to[EEPROM_SIZE - 1] = 0;
+        length = UNIOEEPROMPatch::encode(from, to, sizeof(to), patch, sizeof(patch));
+        fct_xchk((length > 0) && (length < 20), "Expected a short patch got %u", (unsigned)length);
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        ret = EEPROM->applyPatch(patch, length);
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        ret = EEPROM->equals(0, to, sizeof(to));
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        EEPROM->flush();
+        value = unio->writecounter;
+        expect = 4;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        length = UNIOEEPROMPatch::encode(from, to, sizeof(to), patch, 4);
+        fct_xchk(length == 0, "Expected %u got %u", 0, (unsigned)length);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(UNIOEEPROMPatch applies a patch fed one byte at a time) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint8_t from[EEPROM_SIZE], to[EEPROM_SIZE], patch[EEPROM_SIZE + 8];
+        uint16_t index;
+        size_t length;
+        bool ret;
+        memset(from, 0xFF, sizeof(from));
+        for (index = 0; index < EEPROM_SIZE; index++) {
+            to[index] = (index % 3) ? index : 0xFF;
+        }
+        length = UNIOEEPROMPatch::encode(from, to, sizeof(to), patch, sizeof(patch));
+        fct_xchk(length > 0, "Expected a patch got %u", (unsigned)length);
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        UNIOEEPROMPatch decoder(EEPROM);
+        for (index = 0; index < length; index++) {
+            ret = decoder.done();
+            fct_xchk(!ret, "Expected FALSE got TRUE");
+            ret = decoder.feed(&patch[index], 1);
+            fct_xchk(ret, "Expected TRUE got FALSE");
+        }
+        ret = decoder.done();
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        ret = EEPROM->equals(0, to, sizeof(to));
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(applyPatch() returns false for a patch that runs off the end) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint8_t past[] = { 0x80, 0x01, 0x02, 0x00, 0x00, 0x00 };
+        uint8_t longer[] = { EEPROM_SIZE - 1, 0x05, 0x00, 0x00, 0x00 };
+        uint8_t shorter[] = { 0x00, 0x02, 0x00 };
+        bool ret;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        ret = EEPROM->applyPatch(past, sizeof(past));
+        fct_xchk(!ret, "Expected FALSE got TRUE");
+        ret = EEPROM->applyPatch(longer, sizeof(longer));
+        fct_xchk(!ret, "Expected FALSE got TRUE");
+        ret = EEPROM->applyPatch(shorter, sizeof(shorter));
+        fct_xchk(!ret, "Expected FALSE got TRUE");
+        UNIOEEPROMPatch decoder(EEPROM);
+        ret = decoder.feed(longer, sizeof(longer));
+        fct_xchk(!ret, "Expected FALSE got TRUE");
+        ret = decoder.failed();
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        decoder.reset();
+        ret = decoder.failed();
+        fct_xchk(!ret, "Expected FALSE got TRUE");
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(exportDelta() sends the changed pages and applyDelta() copies them) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        UNIO *replicaUnio = new UNIO(0, EEPROM_SIZE);
+        uint8_t buffer[2 * UNIO_DELTA_RECORD];
+        uint8_t data[EEPROM_SIZE];
+        size_t length;
+        bool ret;
+        uint32_t value, expect;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        UNIOEEPROMClass *replica = new UNIOEEPROMClass(replicaUnio, EEPROM_SIZE);
+        EEPROM->begin();
+        replica->begin();
+        EEPROM->write(1, 1);
+        EEPROM->write(3 * UNIO_PAGE_SIZE, 2);
+        EEPROM->write(EEPROM_SIZE - 1, 3);
+        EEPROM->flush();
+        value = EEPROM->changedPages();
+        expect = 3;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        length = EEPROM->exportDelta(buffer, sizeof(buffer));
+        fct_xchk(length == 2 * UNIO_DELTA_RECORD, "Expected %u got %u", 2 * UNIO_DELTA_RECORD, (unsigned)length);
+        ret = replica->applyDelta(buffer, length);
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        length = EEPROM->exportDelta(buffer, sizeof(buffer));
+        fct_xchk(length == UNIO_DELTA_RECORD, "Expected %u got %u", UNIO_DELTA_RECORD, (unsigned)length);
+        ret = replica->applyDelta(buffer, length);
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        length = EEPROM->exportDelta(buffer, sizeof(buffer));
+        fct_xchk(length == 0, "Expected %u got %u", 0, (unsigned)length);
+        EEPROM->readBytes(0, data, sizeof(data));
+        ret = replica->equals(0, data, sizeof(data));
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        replica->flush();
+        value = replicaUnio->writecounter;
+        expect = 3;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        ret = replica->applyDelta(buffer, UNIO_DELTA_RECORD - 1);
+        fct_xchk(!ret, "Expected FALSE got TRUE");
+        delete EEPROM;
+        delete replica;
+        delete replicaUnio;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(checkpoint() clears the changed pages and discard() marks them) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint8_t buffer[UNIO_DELTA_RECORD];
+        size_t length;
+        uint32_t value, expect;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->write(1, 1);
+        EEPROM->checkpoint();
+        value = EEPROM->changedPages();
+        expect = 0;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        EEPROM->discard();
+        length = EEPROM->exportDelta(buffer, sizeof(buffer));
+        fct_xchk(length == UNIO_DELTA_RECORD, "Expected %u got %u", UNIO_DELTA_RECORD, (unsigned)length);
+        value = buffer[3];
+        expect = 0xFF;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        EEPROM->markChanged(0, EEPROM_SIZE);
+        value = EEPROM->changedPages();
+        expect = EEPROM_SIZE / UNIO_PAGE_SIZE;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(setMirror() copies every page written to the second chip) {
+        UNIO *unio = new UNIO(0, 2 * EEPROM_SIZE);
+        UNIO *mirror = new UNIO(0, 2 * EEPROM_SIZE);
+        uint16_t index;
+        bool ret;
+        uint32_t value, expect;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        ret = EEPROM->setMirror(mirror);
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        EEPROM->begin();
+        ret = EEPROM->flush();
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        EEPROM->put(3, (uint32_t)0x12345678);
+        EEPROM->write(3 * UNIO_PAGE_SIZE, 7);
+        for (index = 0; index < 40; index++) {
+            EEPROM->commit();
+        }
+        for (index = 0; index < 2 * EEPROM_SIZE; index++) {
+            value = mirror->get(index);
+            expect = unio->get(index);
+            fct_xchk(value == expect, "Address: %u Expected %u got %u", index, expect, value);
+        }
+        value = mirror->get(3 * UNIO_PAGE_SIZE);
+        expect = 7;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete mirror;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(setMirror() copies a short last page without going past the cache) {
+        UNIO *unio = new UNIO(0, 2 * EEPROM_SIZE);
+        UNIO *mirror = new UNIO(0, 2 * EEPROM_SIZE);
+        size_t last;
+        bool ret;
+        uint32_t value, expect;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, 100);
+        ret = EEPROM->setMirror(mirror);
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        EEPROM->begin();
+        last = EEPROM->size() - 1;
+        EEPROM->write(3, 4);
+        EEPROM->write(last, 9);
+        ret = EEPROM->flush();
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        value = mirror->get(last);
+        expect = 9;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = mirror->get(last + 1);
+        expect = unio->get(last + 1);
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        ret = EEPROM->flush();
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        delete EEPROM;
+        delete mirror;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(setMirror() keeps the CRCs inside a cache as big as the chip) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        UNIO *mirror = new UNIO(0, EEPROM_SIZE);
+        bool ret;
+        uint32_t value, expect;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        ret = EEPROM->setMirror(mirror);
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        value = EEPROM->size();
+        expect = EEPROM_SIZE - UNIO_PAGE_SIZE * ((EEPROM_SIZE / UNIO_PAGE_SIZE + UNIO_PAGE_SIZE - 1) / UNIO_PAGE_SIZE);
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        EEPROM->begin();
+        EEPROM->write(0, 3);
+        ret = EEPROM->flush();
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        value = unio->get(0);
+        expect = 3;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->setMirror(mirror);
+        EEPROM->begin();
+        value = EEPROM->mirrorRepairs();
+        expect = 0;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        ret = EEPROM->flush();
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        delete EEPROM;
+        EEPROM = new UNIOEEPROMClass(unio, UNIO_PAGE_SIZE);
+        ret = EEPROM->setMirror(mirror);
+        fct_xchk(!ret, "Expected FALSE got TRUE");
+        fct_xchk(EEPROM->mirror() == NULL, "Expected NULL got %p", EEPROM->mirror());
+        delete EEPROM;
+        delete mirror;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(beginAsync() checks the mirror like begin()) {
+        UNIO *unio = new UNIO(0, 2 * EEPROM_SIZE);
+        UNIO *mirror = new UNIO(0, 2 * EEPROM_SIZE);
+        uint32_t value, expect;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->setMirror(mirror);
+        EEPROM->begin();
+        EEPROM->write(UNIO_PAGE_SIZE + 1, 5);
+        EEPROM->flush();
+        delete EEPROM;
+        unio->set(UNIO_PAGE_SIZE + 1, 6);
+        EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->setMirror(mirror);
+        EEPROM->beginAsync();
+        fct_xchk(EEPROM->loaded(), "Expected TRUE got FALSE");
+        value = EEPROM->mirrorRepairs();
+        expect = 1;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = EEPROM->read(UNIO_PAGE_SIZE + 1);
+        expect = 5;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete mirror;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(begin() repairs a bad page on the primary from the mirror) {
+        UNIO *unio = new UNIO(0, 2 * EEPROM_SIZE);
+        UNIO *mirror = new UNIO(0, 2 * EEPROM_SIZE);
+        uint32_t value, expect;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->setMirror(mirror);
+        EEPROM->begin();
+        EEPROM->write(UNIO_PAGE_SIZE + 1, 5);
+        EEPROM->flush();
+        delete EEPROM;
+        unio->set(UNIO_PAGE_SIZE + 1, 6);
+        EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->setMirror(mirror);
+        EEPROM->begin();
+        value = EEPROM->mirrorRepairs();
+        expect = 1;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = EEPROM->read(UNIO_PAGE_SIZE + 1);
+        expect = 5;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        EEPROM->flush();
+        value = unio->get(UNIO_PAGE_SIZE + 1);
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->setMirror(mirror);
+        EEPROM->begin();
+        value = EEPROM->mirrorRepairs();
+        expect = 0;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete mirror;
+        delete unio;
+    }
+    FCT_TEST_END()
+
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(setChips() puts runs of pages on each chip with UNIO_CHIPS_CONCAT) {
+        UNIO *unio[4];
+        uint16_t index;
+        bool ret;
+        uint32_t value, expect;
+        for (index = 0; index < 4; index++) {
+            unio[index] = new UNIO(0, EEPROM_SIZE / 4);
+            unio[index]->set(1, index);
+        }
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio[0], EEPROM_SIZE);
+        ret = EEPROM->setChips(unio, 4);
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        EEPROM->begin();
+        for (index = 0; index < 4; index++) {
+            value = EEPROM->read((index * EEPROM_SIZE / 4) + 1);
+            fct_xchk(value == index, "Chip: %u Expected %u got %u", index, index, value);
+        }
+        EEPROM->write(EEPROM_SIZE - 1, 9);
+        EEPROM->write(UNIO_PAGE_SIZE, 8);
+        ret = EEPROM->flush();
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        value = unio[3]->get((EEPROM_SIZE / 4) - 1);
+        expect = 9;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = unio[0]->get(UNIO_PAGE_SIZE);
+        expect = 8;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        ret = EEPROM->setChips(unio, UNIO_EEPROM_CHIPS + 1);
+        fct_xchk(!ret, "Expected FALSE got TRUE");
+        delete EEPROM;
+        for (index = 0; index < 4; index++) {
+            delete unio[index];
+        }
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(commit() keeps every chip writing with UNIO_CHIPS_STRIPE) {
+        UNIO *unio[4];
+        uint16_t index;
+        uint32_t value, expect;
+        for (index = 0; index < 4; index++) {
+            unio[index] = new UNIO(0, EEPROM_SIZE / 4);
+        }
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio[0], EEPROM_SIZE);
+        EEPROM->setChips(unio, 4, UNIO_CHIPS_STRIPE);
+        EEPROM->begin();
+        EEPROM->fill(0, 0, EEPROM_SIZE);
+        for (index = 0; index < 4; index++) {
+            EEPROM->commit();
+        }
+        for (index = 0; index < 4; index++) {
+            value = unio[index]->writecounter;
+            expect = 1;
+            fct_xchk(value == expect, "Chip: %u Expected %u got %u", index, expect, value);
+        }
+        value = unio[1]->get(0);
+        expect = 0;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = unio[1]->get(UNIO_PAGE_SIZE);
+        expect = 0xFF;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        EEPROM->waitDurable(EEPROM->sequence());
+        for (index = 0; index < 4; index++) {
+            value = unio[index]->writecounter;
+            expect = EEPROM_SIZE / UNIO_PAGE_SIZE / 4;
+            fct_xchk(value == expect, "Chip: %u Expected %u got %u", index, expect, value);
+        }
+        delete EEPROM;
+        for (index = 0; index < 4; index++) {
+            delete unio[index];
+        }
+    }
+    FCT_TEST_END()
+
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(commit() waits for a page before a fence() on another chip) {
+        UNIO *unio[2];
+        uint16_t index;
+        uint32_t value, expect;
+        for (index = 0; index < 2; index++) {
+            unio[index] = new UNIO(0, EEPROM_SIZE / 2);
+        }
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio[0], EEPROM_SIZE);
+        EEPROM->setChips(unio, 2, UNIO_CHIPS_STRIPE);
+        EEPROM->begin();
+        EEPROM->write(0, 1);
+        EEPROM->fence();
+        EEPROM->write(UNIO_PAGE_SIZE, 2);
+        EEPROM->commit();
+        value = unio[0]->writecounter;
+        expect = 1;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        EEPROM->commit();
+        EEPROM->commit();
+        // Chip 1 is idle, but page 1 waits for page 0 to finish
+        value = unio[0]->is_writing();
+        fct_xchk(value == 1, "Expected %u got %u", 1, value);
+        value = unio[1]->writecounter;
+        expect = 0;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        UNIO::clock() += UNIO_MOCK_WRITE_US;
+        EEPROM->commit();
+        value = unio[1]->writecounter;
+        expect = 1;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        for (index = 0; index < 2; index++) {
+            delete unio[index];
+        }
+    }
+    FCT_TEST_END()
+
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(commit() on a device smaller than a page) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        bool ret;
+        uint32_t value, expect;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, 8);
+        EEPROM->begin();
+        EEPROM->write(3, 1);
+        ret = EEPROM->commit();
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        value = EEPROM->read(3);
+        expect = 1;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(UNIOEEPROMBase works on a file image with 32 byte pages) {
+        const char *name = "unio_eeprom_test.bin";
+        uint8_t buffer[4];
+        bool ret;
+        uint32_t value, expect;
+        remove(name);
+        UNIOEEPROMFile<32> *file = new UNIOEEPROMFile<32>(name, 256);
+        ret = file->isOpen();
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        UNIOEEPROMBase<UNIOEEPROMFile<32> > *EEPROM = new UNIOEEPROMBase<UNIOEEPROMFile<32> >(file, 256);
+        EEPROM->begin();
+        value = EEPROM->pages();
+        expect = 8;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = EEPROM->read(100);
+        expect = 0xFF;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        EEPROM->fill(0, 0x5A, 256);
+        ret = EEPROM->flush();
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        value = file->writecounter;
+        expect = 8;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete file;
+        file = new UNIOEEPROMFile<32>(name, 256);
+        ret = file->read(buffer, 252, sizeof(buffer));
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        value = buffer[3];
+        expect = 0x5A;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        ret = file->simple_write(buffer, 30, 4);
+        fct_xchk(!ret, "Expected FALSE got TRUE");
+        delete file;
+        remove(name);
+    }
+    FCT_TEST_END()
+
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(exportDelta() records on 32 byte pages are delta_record long) {
+        const char *name = "unio_eeprom_test.bin";
+        typedef UNIOEEPROMBase<UNIOEEPROMFile<32> > FileEEPROM;
+        uint8_t buffer[UNIOEEPROMBackend<UNIOEEPROMFile<32> >::delta_record];
+        size_t length;
+        uint32_t value, expect;
+        remove(name);
+        UNIOEEPROMFile<32> *file = new UNIOEEPROMFile<32>(name, 256);
+        FileEEPROM *EEPROM = new FileEEPROM(file, 256);
+        EEPROM->begin();
+        value = FileEEPROM::DELTA_RECORD;
+        expect = 2 + 32;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        EEPROM->write(40, 1);
+        length = EEPROM->exportDelta(buffer, sizeof(buffer));
+        fct_xchk(length == sizeof(buffer), "Expected %u got %u", (unsigned)sizeof(buffer), (unsigned)length);
+        value = buffer[0];
+        expect = 1;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = buffer[2 + 8];
+        expect = 1;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete file;
+        remove(name);
+    }
+    FCT_TEST_END()
+
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(UNIOEEPROMMap keeps the image in a mapped file across reboots) {
+        const char *name = "unio_eeprom_test.map";
+        bool ret;
+        uint32_t value, expect;
+        remove(name);
+        UNIOEEPROMMap<> *map = new UNIOEEPROMMap<>(name, EEPROM_SIZE);
+        ret = map->isOpen();
+        fct_xchk(ret, "Expected TRUE got FALSE");
+        UNIOEEPROMBase<UNIOEEPROMMap<> > *EEPROM = new UNIOEEPROMBase<UNIOEEPROMMap<> >(map, EEPROM_SIZE);
+        EEPROM->begin();
+        value = EEPROM->read(EEPROM_SIZE - 1);
+        expect = 0xFF;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        EEPROM->put(20, (uint32_t)0x01020304);
+        EEPROM->waitDurable(EEPROM->sequence());
+        value = map->data()[20];
+        expect = 4;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = map->writecounter;
+        expect = 1;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete map;
+        // Reboot
+        map = new UNIOEEPROMMap<>(name, EEPROM_SIZE);
+        EEPROM = new UNIOEEPROMBase<UNIOEEPROMMap<> >(map, EEPROM_SIZE);
+        EEPROM->begin();
+        EEPROM->get(20, value);
+        expect = 0x01020304;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete map;
+        remove(name);
+    }
+    FCT_TEST_END()
+
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(A power cut in flush() leaves the page torn) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint16_t index;
+        bool ret;
+        uint32_t value, expect;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        for (index = 0; index < UNIO_PAGE_SIZE; index++) {
+            EEPROM->write(UNIO_PAGE_SIZE + index, 0x55);
+        }
+        UNIO::cut_power_after(5);
+        ret = EEPROM->flush();
+        fct_xchk(!ret, "Expected FALSE got TRUE");
+        ret = UNIO::powered();
+        fct_xchk(!ret, "Expected FALSE got TRUE");
+        for (index = 0; index < UNIO_PAGE_SIZE; index++) {
+            value = unio->get(UNIO_PAGE_SIZE + index);
+            expect = (index < 5) ? 0x55 : 0xFF;
+            fct_xchk(value == expect, "Address: %u Expected %u got %u", index, expect, value);
+        }
+        delete EEPROM;
+        UNIO::power_on();
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(begin() puts a page torn by a power cut back from the mirror) {
+        UNIO *unio = new UNIO(0, 2 * EEPROM_SIZE);
+        UNIO *mirror = new UNIO(0, 2 * EEPROM_SIZE);
+        uint16_t index;
+        uint32_t value, expect;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->setMirror(mirror);
+        EEPROM->begin();
+        for (index = 0; index < UNIO_PAGE_SIZE; index++) {
+            EEPROM->write(UNIO_PAGE_SIZE + index, 0x55);
+        }
+        EEPROM->flush();
+        for (index = 0; index < UNIO_PAGE_SIZE; index++) {
+            EEPROM->write(UNIO_PAGE_SIZE + index, 0xAA);
+        }
+        UNIO::cut_power_after(5);
+        EEPROM->flush();
+        delete EEPROM;
+        UNIO::power_on();
+        // Reboot
+        EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->setMirror(mirror);
+        EEPROM->begin();
+        value = EEPROM->mirrorRepairs();
+        expect = 1;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        for (index = 0; index < UNIO_PAGE_SIZE; index++) {
+            value = EEPROM->read(UNIO_PAGE_SIZE + index);
+            expect = 0x55;
+            fct_xchk(value == expect, "Address: %u Expected %u got %u", index, expect, value);
+        }
+        delete EEPROM;
+        delete mirror;
+        delete unio;
+    }
+    FCT_TEST_END()
+
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(The trace logs the calls and drops the oldest when full) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint8_t buffer[8 * UNIO_TRACE_RECORD];
+        uint32_t value, expect;
+        uint16_t index;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        EEPROM->begin();
+        mockMillis() = 0x01020304;
+        EEPROM->write(3, 1);
+        EEPROM->read(3);
+        EEPROM->put(4, (uint32_t)5);
+        EEPROM->get(4, value);
+        EEPROM->commit();
+        EEPROM->flush();
+        value = EEPROM->traceCount();
+        expect = 6;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = EEPROM->traceRead(buffer, 2 * UNIO_TRACE_RECORD + 4);
+        expect = 2 * UNIO_TRACE_RECORD;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        const uint8_t first[] = { UNIO_TRACE_WRITE, 1, 3, 0, 4, 3, 2, 1, UNIO_TRACE_READ, 1, 3, 0, 4, 3, 2, 1 };
+        for (index = 0; index < sizeof(first); index++) {
+            value = buffer[index];
+            expect = first[index];
+            fct_xchk(value == expect, "Index %u: Expected %u got %u", index, expect, value);
+        }
+        for (index = 0; index < 8; index++) {
+            EEPROM->write(10 + index, 2);
+        }
+        value = EEPROM->traceLost();
+        expect = 4;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = EEPROM->traceRead(buffer, sizeof(buffer));
+        expect = sizeof(buffer);
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        for (index = 0; index < 8; index++) {
+            value = buffer[index * UNIO_TRACE_RECORD + 2];
+            expect = 10 + index;
+            fct_xchk(value == expect, "Index %u: Expected %u got %u", index, expect, value);
+        }
+        value = EEPROM->traceCount();
+        expect = 0;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        mockMillis() = 0;
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(The trace leaves out calls with a bad address) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint8_t buffer[8];
+        uint32_t value, expect;
+        memset(buffer, 0, sizeof(buffer));
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE, sizeof(buffer));
+        EEPROM->begin();
+        EEPROM->put(EEPROM_SIZE - 2, (uint32_t)5);
+        EEPROM->get(EEPROM_SIZE - 2, value);
+        EEPROM->writeBlock(EEPROM_SIZE / sizeof(buffer), buffer);
+        EEPROM->write(-1, 1);
+        value = EEPROM->traceCount();
+        expect = 0;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        EEPROM->writeBlock(1, buffer);
+        value = EEPROM->traceCount();
+        expect = 1;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(UNIOEEPROMField reads and writes straight in the cache) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        uint32_t value, expect;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        static_assert(UNIOEEPROMClass::pagesUnder(14, 4) == 2, "Two pages");
+        static_assert(UNIOEEPROMClass::pagesUnder(16, 16) == 1, "One page");
+        static_assert(UNIOEEPROMClass::fewestPages(17) == 2, "Two pages");
+        static_assert(UNIOEEPROMField<uint32_t, 14, 2>::pages == 2, "Two pages");
+        EEPROM->begin();
+        UNIOEEPROMField<uint32_t, UNIO_PAGE_SIZE> counter(*EEPROM);
+        UNIOEEPROMField<uint32_t, 14, 2> split(*EEPROM);
+        counter = 0x12345678;
+        value = counter;
+        expect = 0x12345678;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        EEPROM->get(UNIO_PAGE_SIZE, value);
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        split = 0x01020304;
+        value = split.get();
+        expect = 0x01020304;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        EEPROM->flush();
+        value = unio->writecounter;
+        expect = 2;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        value = unio->get(14);
+        expect = 4;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        // The same value again writes nothing
+        split = 0x01020304;
+        EEPROM->flush();
+        value = unio->writecounter;
+        expect = 2;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        // A page that is not write back goes through writeBytes()
+        EEPROM->setWriteMode(UNIO_WRITE_THROUGH);
+        counter = 5;
+        value = unio->writecounter;
+        expect = 3;
+        fct_xchk(value == expect, "Expected %u got %u", expect, value);
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(UNIOEEPROMSchema writes a header on a new part and finds it again) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        int32_t value, expect;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        UNIOEEPROMSchema *schema = new UNIOEEPROMSchema(EEPROM, 2, UNIOEEPROMSchema::hash("v2"), 96);
+        EEPROM->begin();
+        value = schema->begin();
+        expect = UNIO_SCHEMA_NEW;
+        fct_xchk(value == expect, "Expected %d got %d", expect, value);
+        EEPROM->flush();
+        delete schema;
+        schema = new UNIOEEPROMSchema(EEPROM, 2, UNIOEEPROMSchema::hash("v2"), 96);
+        value = schema->begin();
+        expect = UNIO_SCHEMA_OK;
+        fct_xchk(value == expect, "Expected %d got %d", expect, value);
+        delete schema;
+        // The same version with another layout
+        schema = new UNIOEEPROMSchema(EEPROM, 2, UNIOEEPROMSchema::hash("v2b"), 96);
+        value = schema->begin();
+        expect = UNIO_SCHEMA_UNKNOWN;
+        fct_xchk(value == expect, "Expected %d got %d", expect, value);
+        value = schema->reset();
+        fct_xchk(value, "Expected TRUE got FALSE");
+        value = schema->begin();
+        expect = UNIO_SCHEMA_OK;
+        fct_xchk(value == expect, "Expected %d got %d", expect, value);
+        delete schema;
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(UNIOEEPROMSchema will not use a header address inside a page) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        int32_t value, expect;
+        uint16_t index;
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        UNIOEEPROMSchema *schema = new UNIOEEPROMSchema(EEPROM, 2, UNIOEEPROMSchema::hash("v2"), 2 * UNIO_PAGE_SIZE + 4);
+        EEPROM->begin();
+        value = schema->begin();
+        expect = UNIO_SCHEMA_UNKNOWN;
+        fct_xchk(value == expect, "Expected %d got %d", expect, value);
+        value = schema->failed();
+        fct_xchk(value, "Expected TRUE got FALSE");
+        value = schema->reset();
+        fct_xchk(!value, "Expected FALSE got TRUE");
+        value = EEPROM->oldestDirtyPage();
+        expect = -1;
+        fct_xchk(value == expect, "Expected %d got %d", expect, value);
+        for (index = 0; index < EEPROM_SIZE; index++) {
+            value = EEPROM->read(index);
+            fct_xchk(value == 0xFF, "Address: %u Expected %u got %d", index, 0xFF, value);
+        }
+        delete schema;
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(UNIOEEPROMSchema fails a transform that crosses a page) {
+        static const UNIOEEPROMMigration steps[] = {
+            { UNIO_MIGRATE_TRANSFORM, 3 * UNIO_PAGE_SIZE - 2, 16, 4, widen },
+        };
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        int32_t value, expect;
+        schemaSetup(unio);
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        UNIOEEPROMSchema *schema = new UNIOEEPROMSchema(EEPROM, 2, UNIOEEPROMSchema::hash("v2"), 96);
+        schema->addMigration(1, steps, 1);
+        EEPROM->begin();
+        value = schema->begin();
+        expect = UNIO_SCHEMA_MIGRATING;
+        fct_xchk(value == expect, "Expected %d got %d", expect, value);
+        EEPROM->flush();
+        value = schema->step();
+        fct_xchk(!value, "Expected FALSE got TRUE");
+        value = schema->failed();
+        fct_xchk(value, "Expected TRUE got FALSE");
+        delete schema;
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(UNIOEEPROMSchema migrates a piece at a time between commit() calls) {
+        UNIO *unio = new UNIO(0, EEPROM_SIZE);
+        int32_t value, expect;
+        uint16_t steps = 0;
+        schemaSetup(unio);
+        UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        UNIOEEPROMSchema *schema = new UNIOEEPROMSchema(EEPROM, 2, UNIOEEPROMSchema::hash("v2"), 96);
+        value = schema->addMigration(1, schemaV1, 4);
+        fct_xchk(value, "Expected TRUE got FALSE");
+        EEPROM->begin();
+        value = schema->begin();
+        expect = UNIO_SCHEMA_MIGRATING;
+        fct_xchk(value == expect, "Expected %d got %d", expect, value);
+        value = schema->found();
+        expect = 1;
+        fct_xchk(value == expect, "Expected %d got %d", expect, value);
+        while (schema->migrating() && (steps < 1000)) {
+            schema->step();
+            EEPROM->commit();
+            steps++;
+        }
+        fct_xchk(steps > 8, "Expected more than 8 got %u", steps);
+        value = schema->failed();
+        fct_xchk(!value, "Expected FALSE got TRUE");
+        EEPROM->flush();
+        value = schemaCheck(EEPROM);
+        fct_xchk(value, "Expected TRUE got FALSE");
+        delete schema;
+        delete EEPROM;
+        // Reboot
+        EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+        schema = new UNIOEEPROMSchema(EEPROM, 2, UNIOEEPROMSchema::hash("v2"), 96);
+        schema->addMigration(1, schemaV1, 4);
+        EEPROM->begin();
+        value = schema->begin();
+        expect = UNIO_SCHEMA_OK;
+        fct_xchk(value == expect, "Expected %d got %d", expect, value);
+        value = schemaCheck(EEPROM);
+        fct_xchk(value, "Expected TRUE got FALSE");
+        delete schema;
+        delete EEPROM;
+        delete unio;
+    }
+    FCT_TEST_END()
+    /**
+     * @brief Test
+     *
+     * @return void
+     */
+    FCT_TEST_BGN(UNIOEEPROMSchema picks a migration up again after a power cut) {
+        uint16_t cut, steps;
+        int32_t value;
+        for (cut = 0; cut < 400; cut += 7) {
+            UNIO *unio = new UNIO(0, EEPROM_SIZE);
+            schemaSetup(unio);
+            UNIOEEPROMClass *EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+            UNIOEEPROMSchema *schema = new UNIOEEPROMSchema(EEPROM, 2, UNIOEEPROMSchema::hash("v2"), 96);
+            schema->addMigration(1, schemaV1, 4);
+            EEPROM->begin();
+            schema->begin();
+            UNIO::cut_power_after(cut);
+            for (steps = 0; schema->migrating() && UNIO::powered() && (steps < 1000); steps++) {
+                schema->step();
+                EEPROM->commit();
+            }
+            delete schema;
+            delete EEPROM;
+            UNIO::power_on();
+            // Reboot
+            EEPROM = new UNIOEEPROMClass(unio, EEPROM_SIZE);
+            schema = new UNIOEEPROMSchema(EEPROM, 2, UNIOEEPROMSchema::hash("v2"), 96);
+            schema->addMigration(1, schemaV1, 4);
+            EEPROM->begin();
+            value = schema->begin();
+            fct_xchk((value == UNIO_SCHEMA_OK) || (value == UNIO_SCHEMA_MIGRATING),
+                     "Cut %u: Expected OK or MIGRATING got %d", cut, value);
+            value = schema->finish();
+            fct_xchk(value, "Cut %u: Expected TRUE got FALSE", cut);
+            value = schemaCheck(EEPROM);
+            fct_xchk(value, "Cut %u: Expected TRUE got FALSE", cut);
+            delete schema;
+            delete EEPROM;
+            delete unio;
+        }
+    }
+    FCT_TEST_END()
 
 }
 FCTMF_FIXTURE_SUITE_END();
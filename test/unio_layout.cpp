@@ -0,0 +1,475 @@
+/**
+ * @file       test/unio_layout.cpp
+ * @author     Scott L. Price <prices@hugllc.com>
+ * @copyright  © 2016 Hunt Utilities Group, LLC
+ * @brief   Host tool that lays fields out so they change a page at a time
+ * @details
+ *
+ * Usage: unio_layout <fields> <trace> > layout.h
+ *
+ * The fields file has one field a line, "name address size", giving where
+ * the fields are now.  The trace is what traceRead() gave on a device built
+ * with UNIO_EEPROM_TRACE.  The writes between two commit() or flush() calls,
+ * at the same millis(), are taken as one update, and each field a write
+ * lands on is taken as changed by it.
+ *
+ * Fields that change together are put in the same page, and no field of a
+ * page or less is split over two pages.  The new layout is written out as a
+ * header of constexpr offsets for get() and put(), and the page writes per
+ * update before and after are reported.
+ *
+ */
+/*
+ *
+ */
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+#include "UNIO.h"
+#include "UNIO_EEPROM.h"
+
+/** Passes over the fields looking for a better page for each */
+#define LAYOUT_PASSES 20
+
+struct Field {
+    std::string name;
+    int address;
+    int size;
+    int align;
+    int page;      //!< The first page in the new layout
+    int offset;    //!< The new address
+};
+
+static std::vector<Field> fields;
+/** The fields each update changed */
+static std::vector<std::vector<int> > updates;
+
+static bool loadFields(const char *name)
+{
+    FILE *file = fopen(name, "r");
+    char text[64];
+    Field field;
+    if (!file) {
+        perror(name);
+        return false;
+    }
+    while (fscanf(file, "%63s %i %i", text, &field.address, &field.size) == 3) {
+        if ((field.address < 0) || (field.size <= 0)) {
+            continue;
+        }
+        field.name = text;
+        // Natural alignment, up to 4 bytes
+        field.align = 1;
+        while ((field.align < 4) && ((field.size % (field.align * 2)) == 0)) {
+            field.align *= 2;
+        }
+        field.page = -1;
+        field.offset = field.address;
+        fields.push_back(field);
+    }
+    fclose(file);
+    return !fields.empty();
+}
+
+/**
+ * Splits the trace into updates.  Returns the number of writes that missed
+ * every field.
+ */
+static int loadTrace(const char *name)
+{
+    FILE *file = fopen(name, "rb");
+    uint8_t record[UNIO_TRACE_RECORD];
+    std::vector<int> update;
+    uint32_t time, last = 0;
+    int address, length, missed = 0;
+    size_t index;
+    bool hit;
+    if (!file) {
+        perror(name);
+        return -1;
+    }
+    while (fread(record, 1, sizeof(record), file) == sizeof(record)) {
+        address = record[2] | (record[3] << 8);
+        length = record[1];
+        time = record[4] | (record[5] << 8) | ((uint32_t)record[6] << 16) | ((uint32_t)record[7] << 24);
+        if ((record[0] == UNIO_TRACE_COMMIT) || (record[0] == UNIO_TRACE_FLUSH) || (time != last)) {
+            if (!update.empty()) {
+                updates.push_back(update);
+                update.clear();
+            }
+            last = time;
+        }
+        if ((record[0] != UNIO_TRACE_WRITE) && (record[0] != UNIO_TRACE_PUT)
+            && (record[0] != UNIO_TRACE_BLOCK)) {
+            continue;
+        }
+        hit = false;
+        for (index = 0; index < fields.size(); index++) {
+            if ((address < (fields[index].address + fields[index].size))
+                && ((address + length) > fields[index].address)) {
+                if (std::find(update.begin(), update.end(), (int)index) == update.end()) {
+                    update.push_back(index);
+                }
+                hit = true;
+            }
+        }
+        missed += hit ? 0 : 1;
+    }
+    if (!update.empty()) {
+        updates.push_back(update);
+    }
+    fclose(file);
+    return missed;
+}
+
+/**
+ * The pages written for every update, with the fields in the new layout or,
+ * with current set, where they are now
+ */
+static uint64_t cost(bool current)
+{
+    std::vector<int> pages;
+    uint64_t ret = 0;
+    size_t update, index;
+    int page, address;
+    for (update = 0; update < updates.size(); update++) {
+        pages.clear();
+        for (index = 0; index < updates[update].size(); index++) {
+            const Field &field = fields[updates[update][index]];
+            address = current ? field.address : field.offset;
+            for (page = address / UNIO_PAGE_SIZE; page <= (address + field.size - 1) / UNIO_PAGE_SIZE; page++) {
+                if (std::find(pages.begin(), pages.end(), page) == pages.end()) {
+                    pages.push_back(page);
+                }
+            }
+        }
+        ret += pages.size();
+    }
+    return ret;
+}
+
+static bool byAlign(int one, int two)
+{
+    if (fields[one].align != fields[two].align) {
+        return fields[one].align > fields[two].align;
+    }
+    return fields[one].size > fields[two].size;
+}
+
+/**
+ * Works out the addresses of the fields in page.  Returns false if they do
+ * not fit.
+ */
+static bool place(int page, int base)
+{
+    std::vector<int> in;
+    size_t index;
+    int start = base + (page * UNIO_PAGE_SIZE);
+    int address = start;
+    for (index = 0; index < fields.size(); index++) {
+        if (fields[index].size <= UNIO_PAGE_SIZE) {
+            if (fields[index].page == page) {
+                in.push_back(index);
+            }
+        } else if ((fields[index].offset < (start + UNIO_PAGE_SIZE))
+                   && ((fields[index].offset + fields[index].size) > address)) {
+            // The end of a big field
+            address = fields[index].offset + fields[index].size;
+        }
+    }
+    std::sort(in.begin(), in.end(), byAlign);
+    for (index = 0; index < in.size(); index++) {
+        address = (address + fields[in[index]].align - 1) & ~(fields[in[index]].align - 1);
+        fields[in[index]].offset = address;
+        address += fields[in[index]].size;
+    }
+    return address <= (start + UNIO_PAGE_SIZE);
+}
+
+/**
+ * How many times the fields in group changed along with the fields in page
+ */
+static int affinity(const std::vector<int> &group, int page)
+{
+    size_t update, index, member;
+    int ret = 0;
+    for (update = 0; update < updates.size(); update++) {
+        const std::vector<int> &changed = updates[update];
+        for (member = 0; member < group.size(); member++) {
+            if (std::find(changed.begin(), changed.end(), group[member]) == changed.end()) {
+                continue;
+            }
+            for (index = 0; index < changed.size(); index++) {
+                if (fields[changed[index]].page == page) {
+                    ret++;
+                }
+            }
+        }
+    }
+    return ret;
+}
+
+/**
+ * Tries field in page.  It is left there if it fits.
+ */
+static bool tryPage(int field, int page, int base)
+{
+    int old = fields[field].page;
+    fields[field].page = page;
+    if (place(page, base)) {
+        if (old >= 0) {
+            place(old, base);
+        }
+        return true;
+    }
+    fields[field].page = old;
+    place(page, base);
+    return false;
+}
+
+/**
+ * Moves every field in group to page, if they all fit.  A page of -1 takes
+ * them out of the layout.
+ */
+static bool tryGroup(const std::vector<int> &group, int page, int base)
+{
+    std::vector<int> old;
+    size_t index;
+    for (index = 0; index < group.size(); index++) {
+        old.push_back(fields[group[index]].page);
+        fields[group[index]].page = page;
+    }
+    if ((page < 0) || place(page, base)) {
+        for (index = 0; index < group.size(); index++) {
+            if ((old[index] >= 0) && (old[index] != page)) {
+                place(old[index], base);
+            }
+        }
+        return true;
+    }
+    for (index = 0; index < group.size(); index++) {
+        fields[group[index]].page = old[index];
+    }
+    place(page, base);
+    return false;
+}
+
+static int groupSize(const std::vector<int> &group)
+{
+    size_t index;
+    int ret = 0;
+    for (index = 0; index < group.size(); index++) {
+        ret += fields[group[index]].size;
+    }
+    return ret;
+}
+
+static int layout(int base)
+{
+    std::vector<int> order;
+    std::vector<std::vector<int> > groups;
+    std::vector<uint32_t> changes(fields.size(), 0);
+    uint64_t best, now;
+    size_t index, update;
+    int pages = 0, small, page, pass, old, field, score, top, pick;
+    bool better;
+
+    for (update = 0; update < updates.size(); update++) {
+        for (index = 0; index < updates[update].size(); index++) {
+            changes[updates[update][index]]++;
+        }
+    }
+    // Fields bigger than a page get their own pages first
+    for (index = 0; index < fields.size(); index++) {
+        if (fields[index].size > UNIO_PAGE_SIZE) {
+            fields[index].page = pages;
+            fields[index].offset = base + (pages * UNIO_PAGE_SIZE);
+            pages += (fields[index].size + UNIO_PAGE_SIZE - 1) / UNIO_PAGE_SIZE;
+        } else {
+            order.push_back(index);
+        }
+    }
+    small = pages;
+    // Fields that change together are grouped, the pair of groups that change
+    // together most first, as long as the group fits in a page
+    for (index = 0; index < order.size(); index++) {
+        groups.push_back(std::vector<int>(1, order[index]));
+    }
+    for (;;) {
+        size_t one, two, pickOne = 0, pickTwo = 0;
+        top = 0;
+        for (one = 0; one < groups.size(); one++) {
+            for (two = one + 1; two < groups.size(); two++) {
+                if ((groupSize(groups[one]) + groupSize(groups[two])) > UNIO_PAGE_SIZE) {
+                    continue;
+                }
+                // Put the second group in a page of its own for affinity()
+                for (index = 0; index < groups[two].size(); index++) {
+                    fields[groups[two][index]].page = -2;
+                }
+                score = affinity(groups[one], -2);
+                for (index = 0; index < groups[two].size(); index++) {
+                    fields[groups[two][index]].page = -1;
+                }
+                if (score > top) {
+                    top = score;
+                    pickOne = one;
+                    pickTwo = two;
+                }
+            }
+        }
+        if (top == 0) {
+            break;
+        }
+        groups[pickOne].insert(groups[pickOne].end(), groups[pickTwo].begin(), groups[pickTwo].end());
+        groups.erase(groups.begin() + pickTwo);
+    }
+    // The busiest groups go first, each in the page it changes with most, or
+    // the first page it fits in
+    std::sort(groups.begin(), groups.end(), [&](const std::vector<int> &one, const std::vector<int> &two) {
+        uint32_t first = 0, second = 0;
+        size_t member;
+        for (member = 0; member < one.size(); member++) {
+            first += changes[one[member]];
+        }
+        for (member = 0; member < two.size(); member++) {
+            second += changes[two[member]];
+        }
+        return first > second;
+    });
+    for (index = 0; index < groups.size(); index++) {
+        pick = -1;
+        top = -1;
+        for (page = 0; page < pages; page++) {
+            score = affinity(groups[index], page);
+            if ((score > top) && tryGroup(groups[index], page, base)) {
+                top = score;
+                pick = page;
+                tryGroup(groups[index], -1, base);
+                place(page, base);
+            }
+        }
+        if (pick < 0) {
+            pick = pages++;
+        }
+        if (!tryGroup(groups[index], pick, base)) {
+            // Padding made it too big for a page.  Split it up.
+            for (size_t member = 0; member < groups[index].size(); member++) {
+                field = groups[index][member];
+                if (!tryPage(field, pick, base)) {
+                    tryPage(field, pages++, base);
+                }
+            }
+        }
+    }
+    // Then move fields between pages while that saves page writes
+    best = cost(false);
+    for (pass = 0; pass < LAYOUT_PASSES; pass++) {
+        better = false;
+        for (index = 0; index < order.size(); index++) {
+            field = order[index];
+            for (page = 0; page <= pages; page++) {
+                old = fields[field].page;
+                if ((page == old) || !tryPage(field, page, base)) {
+                    continue;
+                }
+                now = cost(false);
+                if (now < best) {
+                    best = now;
+                    better = true;
+                    pages += (page == pages) ? 1 : 0;
+                } else {
+                    tryPage(field, old, base);
+                }
+            }
+        }
+        if (!better) {
+            break;
+        }
+    }
+    // Close up pages left empty
+    for (page = pages - 1; page >= small; page--) {
+        for (index = 0; index < order.size(); index++) {
+            if (fields[order[index]].page == page) {
+                break;
+            }
+        }
+        if (index < order.size()) {
+            continue;
+        }
+        for (index = 0; index < order.size(); index++) {
+            if (fields[order[index]].page > page) {
+                fields[order[index]].page--;
+            }
+        }
+        pages--;
+    }
+    for (page = small; page < pages; page++) {
+        place(page, base);
+    }
+    return pages;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t before, after;
+    int missed, base, pages, end = 0;
+    size_t index;
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <fields> <trace>\n", argv[0]);
+        return 1;
+    }
+    if (!loadFields(argv[1])) {
+        fprintf(stderr, "No fields in %s\n", argv[1]);
+        return 1;
+    }
+    missed = loadTrace(argv[2]);
+    if (missed < 0) {
+        return 1;
+    }
+    if (updates.empty()) {
+        fprintf(stderr, "No updates to the fields in %s\n", argv[2]);
+        return 1;
+    }
+    base = fields[0].address;
+    for (index = 0; index < fields.size(); index++) {
+        base = std::min(base, fields[index].address);
+    }
+    base -= base % UNIO_PAGE_SIZE;
+    before = cost(true);
+    pages = layout(base);
+    after = cost(false);
+    for (index = 0; index < fields.size(); index++) {
+        end = std::max(end, fields[index].offset + fields[index].size);
+    }
+
+    fprintf(stderr, "%u updates, %u writes outside the fields\n", (unsigned) updates.size(), missed);
+    fprintf(stderr, "Page writes per update: %.2f now, %.2f with this layout (%.0f%% fewer)\n",
+            (double) before / updates.size(), (double) after / updates.size(),
+            before ? 100.0 * (before - after) / before : 0.0);
+    fprintf(stderr, "%d pages, %d bytes from %d\n", pages, end - base, base);
+    for (index = 0; index < fields.size(); index++) {
+        fprintf(stderr, "  %-24s %5d -> %5d\n", fields[index].name.c_str(), fields[index].address,
+                fields[index].offset);
+    }
+
+    printf("/*\n");
+    printf("  Made by unio_layout from %s.  Do not edit.\n\n", argv[2]);
+    printf("  Page writes per update: %.2f before, %.2f with this layout\n",
+           (double) before / updates.size(), (double) after / updates.size());
+    printf("*/\n\n");
+    printf("#ifndef UNIO_EEPROM_Layout_h\n");
+    printf("#define UNIO_EEPROM_Layout_h\n\n");
+    printf("struct UNIOEEPROMLayout {\n");
+    for (index = 0; index < fields.size(); index++) {
+        printf("    static constexpr int %s = %d;  //!< %d byte%s\n", fields[index].name.c_str(),
+               fields[index].offset, fields[index].size, (fields[index].size == 1) ? "" : "s");
+    }
+    printf("    static constexpr int end = %d;\n", end);
+    printf("};\n\n");
+    printf("#endif // UNIO_EEPROM_Layout_h\n");
+    return 0;
+}
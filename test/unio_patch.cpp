@@ -0,0 +1,66 @@
+/**
+ * @file       test/unio_patch.cpp
+ * @author     Scott L. Price <prices@hugllc.com>
+ * @copyright  © 2016 Hunt Utilities Group, LLC
+ * @brief   Host tool that builds a patch for UNIOEEPROMClass::applyPatch()
+ * @details
+ *
+ * Usage: unio_patch <old image> <new image> > patch
+ *
+ * The images must be the same size.
+ *
+ */
+/*
+ *
+ */
+#include <stdio.h>
+#include <vector>
+#include "Arduino.h"
+#include "UNIO.h"
+#include "UNIO_EEPROM.h"
+
+/**
+ * Reads a whole file into image.  Returns false if it can not be read.
+ */
+static bool readImage(const char *name, std::vector<uint8_t> &image)
+{
+    FILE *file = fopen(name, "rb");
+    uint8_t buffer[256];
+    size_t length;
+    if (!file) {
+        perror(name);
+        return false;
+    }
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        image.insert(image.end(), buffer, buffer + length);
+    }
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<uint8_t> from, to, patch;
+    size_t length;
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <old image> <new image>\n", argv[0]);
+        return 1;
+    }
+    if (!readImage(argv[1], from) || !readImage(argv[2], to)) {
+        return 1;
+    }
+    if (from.size() != to.size()) {
+        fprintf(stderr, "The images are not the same size\n");
+        return 1;
+    }
+    // The worst case is a data record with a varint in front of every byte
+    patch.resize((2 * to.size()) + 16);
+    length = UNIOEEPROMPatch::encode(from.data(), to.data(), to.size(), patch.data(), patch.size());
+    if (length == 0) {
+        fprintf(stderr, "The patch did not fit\n");
+        return 1;
+    }
+    fwrite(patch.data(), 1, length, stdout);
+    fprintf(stderr, "%u byte patch\n", (unsigned) length);
+    return 0;
+}
@@ -0,0 +1,339 @@
+/**
+ * @file       test/wear_unio_eeprom.cpp
+ * @author     Scott L. Price <prices@hugllc.com>
+ * @copyright  © 2016 Hunt Utilities Group, LLC
+ * @brief   Fleet wear projection for UNIO_EEPROM.cpp
+ * @details
+ *
+ * Usage: run_wear [nodes] [flush every] [workload]
+ *
+ * Runs one day of a workload on each node of a fleet, each with its own
+ * UNIOEEPROMClass and mock chip, then projects how long the most worn page on
+ * each node lasts.  Each node gets one of the synthetic workload mixes and a
+ * rate, or replays the workload file if one is given.  Updates are written
+ * back with flush() after every "flush every" updates, which is the
+ * persistence cadence being looked at.  A "flush every" of 0 calls commit()
+ * after every update instead, so pages go out one a call at the cache's own
+ * pace, and flush()es only at the end of the day.
+ *
+ * The workload file has one update a line, "address length", in decimal or
+ * 0x hex.  Each node goes through it in a loop.
+ *
+ * The nodes are run on a work stealing pool with a thread for every core.
+ *
+ */
+/*
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <math.h>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "Arduino.h"
+#include "UNIO.h"
+#include "UNIO_EEPROM.h"
+
+#define WEAR_NODES 10000
+/** Write cycles a page is good for, from the 11AA data sheet */
+#define WEAR_ENDURANCE 1000000.0
+/** The spread of the endurance from part to part */
+#define WEAR_ENDURANCE_SPREAD 0.1
+/** Bus time between updates, in us.  Long enough for any write cycle. */
+#define WEAR_IDLE_US 100000
+#define WEAR_PAGES (EEPROM_SIZE / UNIO_PAGE_SIZE)
+#define WEAR_LOG_START 256
+#define WEAR_LOG_END 1024
+
+/**
+ * A synthetic workload mix
+ */
+struct Mix {
+    const char *name;
+    uint32_t perDay;
+};
+
+enum { MIX_COUNTER, MIX_CONFIG, MIX_LOG, MIX_MIXED, MIX_RECORDED };
+
+static const Mix mixes[] = {
+    { "counter", 1440 },
+    { "config", 24 },
+    { "log", 288 },
+    { "mixed", 600 },
+    { "recorded", 1440 },
+};
+
+/**
+ * One update from the workload file
+ */
+struct Update {
+    uint16_t address;
+    uint16_t length;
+};
+
+static std::vector<Update> recorded;
+static uint32_t flushEvery = 1;
+
+/**
+ * What one node did in its day
+ */
+struct Node {
+    uint8_t mix;
+    uint32_t updates;
+    uint32_t wear[WEAR_PAGES];
+    double years;
+};
+
+/**
+ * A pool of workers, each with its own queue of tasks.  A worker takes from
+ * the back of its own queue, and when that is empty, steals from the front of
+ * the others.
+ */
+class Pool {
+public:
+    Pool(uint32_t workers) : _queue(workers), _lock(workers)
+    {
+    }
+    void add(uint32_t worker, uint32_t task)
+    {
+        std::lock_guard<std::mutex> lock(_lock[worker]);
+        _queue[worker].push_back(task);
+    }
+    bool take(uint32_t worker, uint32_t &task)
+    {
+        uint32_t index, victim;
+        for (index = 0; index < _queue.size(); index++) {
+            victim = (worker + index) % _queue.size();
+            std::lock_guard<std::mutex> lock(_lock[victim]);
+            if (_queue[victim].empty()) {
+                continue;
+            }
+            if (victim == worker) {
+                task = _queue[victim].back();
+                _queue[victim].pop_back();
+            } else {
+                task = _queue[victim].front();
+                _queue[victim].pop_front();
+            }
+            return true;
+        }
+        return false;
+    }
+
+private:
+    std::vector<std::deque<uint32_t> > _queue;
+    std::vector<std::mutex> _lock;
+};
+
+/**
+ * Makes one update.  The data always changes, so every update dirties the
+ * pages it lands on.
+ */
+static void update(UNIOEEPROMClass &EEPROM, uint8_t mix, uint32_t count, std::mt19937 &rng)
+{
+    uint8_t data[UNIO_PAGE_SIZE * 2];
+    uint16_t address = 0, length = 0;
+    if (mix == MIX_MIXED) {
+        mix = rng() % MIX_MIXED;
+    }
+    switch (mix) {
+    case MIX_COUNTER:
+        EEPROM.put(0, count);
+        return;
+    case MIX_CONFIG:
+        // A 24 byte struct over two pages, with a few fields changed
+        address = 40;
+        length = 24;
+        EEPROM.readBytes(address, data, length);
+        data[rng() % length] ^= 1 + (rng() % 0xFF);
+        data[rng() % length] ^= 1 + (rng() % 0xFF);
+        EEPROM.writeBytes(address, data, length);
+        return;
+    case MIX_LOG:
+        address = WEAR_LOG_START + ((count * 8) % (WEAR_LOG_END - WEAR_LOG_START));
+        length = 8;
+        break;
+    case MIX_RECORDED:
+        address = recorded[count % recorded.size()].address;
+        length = recorded[count % recorded.size()].length;
+        break;
+    }
+    while (length > 0) {
+        uint16_t chunk = std::min<uint16_t>(length, sizeof(data));
+        memset(data, (uint8_t)(count + length), chunk);
+        data[0] ^= (uint8_t)(count >> 8);
+        EEPROM.writeBytes(address, data, chunk);
+        address += chunk;
+        length -= chunk;
+    }
+}
+
+/**
+ * Runs a day on one node.  Everything about the node comes from its number,
+ * so it does not matter which thread runs it.
+ */
+static void simulate(uint32_t id, Node &node)
+{
+    std::mt19937 rng(id);
+    std::normal_distribution<double> spread(1.0, WEAR_ENDURANCE_SPREAD);
+    std::uniform_real_distribution<double> rate(0.5, 2.0);
+    UNIO unio(0, EEPROM_SIZE);
+    UNIOEEPROMClass EEPROM(&unio, EEPROM_SIZE);
+    uint32_t count, page, worst = 0;
+
+    node.mix = recorded.empty() ? (uint8_t)(rng() % MIX_RECORDED) : (uint8_t) MIX_RECORDED;
+    node.updates = mixes[node.mix].perDay * rate(rng);
+    EEPROM.begin();
+    for (count = 0; count < node.updates; count++) {
+        update(EEPROM, node.mix, count, rng);
+        if (flushEvery == 0) {
+            EEPROM.commit();
+        } else if (((count + 1) % flushEvery) == 0) {
+            EEPROM.flush();
+        }
+        UNIO::clock() += WEAR_IDLE_US;
+    }
+    EEPROM.flush();
+    for (page = 0; page < WEAR_PAGES; page++) {
+        node.wear[page] = unio.wear(page);
+        worst = std::max(worst, node.wear[page]);
+    }
+    if (worst > 0) {
+        node.years = WEAR_ENDURANCE * std::max(0.5, spread(rng)) / worst / 365.0;
+    } else {
+        node.years = INFINITY;
+    }
+}
+
+static void worker(Pool &pool, uint32_t self, std::vector<Node> &nodes)
+{
+    uint32_t id;
+    while (pool.take(self, id)) {
+        simulate(id, nodes[id]);
+    }
+}
+
+static bool load(const char *name)
+{
+    FILE *file = fopen(name, "r");
+    long address, length;
+    Update update;
+    if (!file) {
+        return false;
+    }
+    while (fscanf(file, "%li %li", &address, &length) == 2) {
+        if ((address < 0) || (length <= 0) || ((address + length) > EEPROM_SIZE)) {
+            continue;
+        }
+        update.address = address;
+        update.length = length;
+        recorded.push_back(update);
+    }
+    fclose(file);
+    return !recorded.empty();
+}
+
+static double percentile(std::vector<double> &years, double pct)
+{
+    if (years.empty()) {
+        return NAN;
+    }
+    return years[std::min<size_t>(years.size() - 1, years.size() * pct / 100.0)];
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t count = (argc > 1) ? strtoul(argv[1], NULL, 0) : WEAR_NODES;
+    uint32_t threads = std::max(1u, std::thread::hardware_concurrency());
+    static const double bounds[] = { 1, 2, 5, 10, 20, 50, INFINITY };
+    uint32_t index, page, bucket, mix;
+    if (argc > 2) {
+        flushEvery = strtoul(argv[2], NULL, 0);
+    }
+    if ((argc > 3) && !load(argv[3])) {
+        fprintf(stderr, "No updates in %s\n", argv[3]);
+        return 1;
+    }
+    std::vector<Node> nodes(count);
+    std::vector<std::thread> pool;
+    Pool tasks(threads);
+    for (index = 0; index < count; index++) {
+        tasks.add(index % threads, index);
+    }
+    for (index = 0; index < threads; index++) {
+        pool.push_back(std::thread(worker, std::ref(tasks), index, std::ref(nodes)));
+    }
+    for (index = 0; index < threads; index++) {
+        pool[index].join();
+    }
+
+    if (flushEvery == 0) {
+        printf("UNIO_EEPROM fleet wear (%" PRIu32 " nodes on %" PRIu32 " threads, commit() every update)\n",
+               count, threads);
+    } else {
+        printf("UNIO_EEPROM fleet wear (%" PRIu32 " nodes on %" PRIu32 " threads, flush() every %" PRIu32 " updates)\n",
+               count, threads, flushEvery);
+    }
+
+    printf("\n%-10s %7s %12s %16s %9s %9s %9s %9s\n", "mix", "nodes", "updates/day",
+           "page writes/day", "min", "1%", "10%", "50%");
+    printf("%-10s %7s %12s %16s %39s\n", "", "", "", "", "years to first page worn out");
+    for (mix = 0; mix <= MIX_RECORDED; mix++) {
+        std::vector<double> years;
+        uint64_t updates = 0, writes = 0;
+        for (index = 0; index < count; index++) {
+            if (nodes[index].mix != mix) {
+                continue;
+            }
+            updates += nodes[index].updates;
+            for (page = 0; page < WEAR_PAGES; page++) {
+                writes += nodes[index].wear[page];
+            }
+            years.push_back(nodes[index].years);
+        }
+        if (years.empty()) {
+            continue;
+        }
+        std::sort(years.begin(), years.end());
+        printf("%-10s %7zu %12.0f %16.0f %9.1f %9.1f %9.1f %9.1f\n", mixes[mix].name, years.size(),
+               (double) updates / years.size(), (double) writes / years.size(),
+               years[0], percentile(years, 1), percentile(years, 10), percentile(years, 50));
+    }
+
+    printf("\nYears to first page worn out\n");
+    for (bucket = 0; bucket < (sizeof(bounds) / sizeof(bounds[0])); bucket++) {
+        uint32_t nodesIn = 0;
+        double low = (bucket > 0) ? bounds[bucket - 1] : 0;
+        // The last bucket takes the nodes that never wore a page
+        bool last = (bucket + 1) == (sizeof(bounds) / sizeof(bounds[0]));
+        for (index = 0; index < count; index++) {
+            if ((nodes[index].years >= low) && (last || (nodes[index].years < bounds[bucket]))) {
+                nodesIn++;
+            }
+        }
+        printf("  %4.0f - %-4.0f %7" PRIu32 " %5.1f%%\n", low, bounds[bucket], nodesIn,
+               100.0 * nodesIn / std::max(1u, count));
+    }
+
+    printf("\nWrites/day to each page, over the fleet\n");
+    printf("%6s %10s %10s %9s\n", "page", "mean", "max", "nodes");
+    for (page = 0; page < WEAR_PAGES; page++) {
+        uint64_t total = 0;
+        uint32_t most = 0, used = 0;
+        for (index = 0; index < count; index++) {
+            total += nodes[index].wear[page];
+            most = std::max(most, nodes[index].wear[page]);
+            used += (nodes[index].wear[page] > 0) ? 1 : 0;
+        }
+        if (used > 0) {
+            printf("%6" PRIu32 " %10.1f %10" PRIu32 " %9" PRIu32 "\n", page,
+                   (double) total / std::max(1u, count), most, used);
+        }
+    }
+    return 0;
+}